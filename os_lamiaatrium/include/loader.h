@@ -5,5 +5,7 @@
 
 struct pcb_t * load(const char * path);
 
+uint32_t get_pid(void);
+
 #endif
 
@@ -16,17 +16,51 @@
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
+#ifdef MM64
+#define PAGING_PTE_PRESENT_MASK BIT_ULL(63)
+#define PAGING_PTE_SWAPPED_MASK BIT_ULL(62)
+#define PAGING_PTE_RESERVE_MASK BIT_ULL(61)
+#define PAGING_PTE_DIRTY_MASK BIT_ULL(60)
+#define PAGING_PTE_EMPTY01_MASK BIT_ULL(42)
+#define PAGING_PTE_EMPTY02_MASK BIT_ULL(41)
+#else
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
 #define PAGING_PTE_RESERVE_MASK BIT(29)
 #define PAGING_PTE_DIRTY_MASK BIT(28)
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
+#endif
+#define PAGING_PTE_COW_MASK PAGING_PTE_RESERVE_MASK /* shared frame, copy on write */
+#define PAGING_PTE_HUGE_MASK PAGING_PTE_EMPTY01_MASK /* PMD leaf, maps a 2MB frame run */
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_SWAPPED(pte) (pte&PAGING_PTE_SWAPPED_MASK)
+#define PAGING_PAGE_COW(pte) (pte&PAGING_PTE_COW_MASK)
+#define PAGING_PAGE_HUGE(pte) (pte&PAGING_PTE_HUGE_MASK)
+
+#ifdef MM64
+/* USRNUM */
+#define PAGING_PTE_USRNUM_LOBIT 43
+#define PAGING_PTE_USRNUM_HIBIT 59
+/* FPN, 40 bits cover 4 PiB of 4KB frames */
+#define PAGING_PTE_FPN_LOBIT 0
+#define PAGING_PTE_FPN_HIBIT 39
+/* SWPTYP */
+#define PAGING_PTE_SWPTYP_LOBIT 0
+#define PAGING_PTE_SWPTYP_HIBIT 4
+/* SWPOFF */
+#define PAGING_PTE_SWPOFF_LOBIT 5
+#define PAGING_PTE_SWPOFF_HIBIT 40
 
+/* PTE */
+#define PAGING_PTE_USRNUM_MASK GENMASK_ULL(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
+#define PAGING_PTE_FPN_MASK    GENMASK_ULL(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP_MASK GENMASK_ULL(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF_MASK GENMASK_ULL(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#else
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
 #define PAGING_PTE_USRNUM_HIBIT 27
@@ -45,6 +79,7 @@
 #define PAGING_PTE_FPN_MASK    GENMASK(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWPTYP_MASK GENMASK(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
 #define PAGING_PTE_SWPOFF_MASK GENMASK(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#endif
 
 /* Extract PTE */
 #define PAGING_PTE_OFFST(pte) GETVAL(pte,PAGING_OFFST_MASK,PAGING_ADDR_OFFST_LOBIT)
@@ -68,6 +103,7 @@
 #define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
 #define PAGING_SWP(pte) ((pte&PAGING_PTE_SWPOFF_MASK) >> PAGING_SWPFPN_OFFSET)
+#define PAGING_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
 
 /* Value operators */
 #define SETBIT(v,mask) (v=v|mask)
@@ -106,6 +142,7 @@ int enlist_pgn_node(struct pgn_t **pgnlist, addr_t pgn);
 int vmap_pgd_memset(struct pcb_t *caller, addr_t addr, int pgnum);
 addr_t vmap_page_range(struct pcb_t *caller, addr_t addr, int pgnum, 
                     struct framephy_struct *frames, struct vm_rg_struct *ret_rg);
+int vmap_huge_range(struct pcb_t *caller, addr_t addr, int hpnum);
 addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
 addr_t alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
@@ -114,8 +151,8 @@ int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr
 int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn);
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff);
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val);
+pte_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, pte_t pte_val);
 int init_pte(addr_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
@@ -128,6 +165,8 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int exit_mm(struct mm_struct *mm, struct memphy_struct *mram);
+int dup_mm(struct mm_struct *mm, struct mm_struct *newmm, struct memphy_struct *mram);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -148,15 +187,93 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, a
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz);
 int find_victim_page(struct mm_struct* mm, addr_t *pgn);
+int pg_evict_victim(struct pcb_t *caller, addr_t *retfpn);
+int pg_reclaim_frame(struct pcb_t *caller, addr_t *retfpn);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
+/* Background reclaim prototypes */
+int kswapd_init(struct memphy_struct *mram, int low, int high);
+void kswapd_stop(void);
+int kswapd_register(struct pcb_t *proc);
+void kswapd_unregister(struct pcb_t *proc);
+void kswapd_wakeup(void);
+int kswapd_direct_reclaim(int nr);
+int __kswapd_reclaim(int nr);
+
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int num, addr_t *fpn);
+int MEMPHY_get_zerofp_range(struct memphy_struct *mp, int num, addr_t *fpn);
+int MEMPHY_put_freefp_range(struct memphy_struct *mp, addr_t fpn, int num);
+int MEMPHY_nr_freefp(struct memphy_struct *mp);
+int MEMPHY_get_zerofp(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_zero_refill(struct memphy_struct *mp, int reserve);
+int MEMPHY_clear_frame(struct memphy_struct *mp, addr_t fpn);
+void MEMPHY_set_cpu(int cpuid);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
+int MEMPHY_read_block(struct memphy_struct *mp, addr_t addr, BYTE *buf, addr_t len);
+int MEMPHY_write_block(struct memphy_struct *mp, addr_t addr, const BYTE *buf, addr_t len);
+int MEMPHY_read32(struct memphy_struct *mp, addr_t addr, uint32_t *value);
+int MEMPHY_write32(struct memphy_struct *mp, addr_t addr, uint32_t value);
+int MEMPHY_read64(struct memphy_struct *mp, addr_t addr, uint64_t *value);
+int MEMPHY_write64(struct memphy_struct *mp, addr_t addr, uint64_t value);
+int MEMPHY_read64_array(struct memphy_struct *mp, addr_t addr, uint64_t *values, int nr);
+int MEMPHY_write64_array(struct memphy_struct *mp, addr_t addr, const uint64_t *values, int nr);
+int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset);
+uint64_t MEMPHY_get_seekdist(struct memphy_struct *mp, uint64_t *nr_seek);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_dump_range(struct memphy_struct *mp, addr_t start, addr_t end, int pid, FILE *out);
+int MEMPHY_dump_frames(struct memphy_struct *mp, addr_t *fpns, int nr, int pid, FILE *out);
+int MEMPHY_set_rmap(struct memphy_struct *mp, addr_t fpn, struct mm_struct *mm, addr_t pgn);
+struct mm_struct *MEMPHY_get_rmap(struct memphy_struct *mp, addr_t fpn, addr_t *pgn);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path);
+int free_memphy(struct memphy_struct *mp);
+
+/* Swap device and I/O scheduler protypes */
+int swap_on(struct memphy_struct *mp, int swptyp, int prio);
+struct memphy_struct *swap_get_dev(int swptyp);
+int swap_get_slot(int *swptyp, addr_t *swpfpn);
+int swap_dup_slot(int swptyp, addr_t swpfpn);
+int swap_free_slot(int swptyp, addr_t swpfpn);
+int swap_read_slot(int swptyp, addr_t swpfpn, struct memphy_struct *dst, addr_t dstfpn);
+int swap_write_slot(int swptyp, addr_t swpfpn, struct memphy_struct *src, addr_t srcfpn);
+int swap_ioq_init(struct memphy_struct *mp);
+int swap_ioq_write(struct memphy_struct *mp, addr_t swpfpn, struct memphy_struct *src, addr_t srcfpn);
+int swap_ioq_read(struct memphy_struct *mp, addr_t swpfpn, struct memphy_struct *dst, addr_t dstfpn);
+int swap_ioq_flush(struct memphy_struct *mp);
+void swap_ioq_report(struct memphy_struct *mp, int id);
+void swap_report(void);
+
+/* Compressed swap cache protypes */
+int zswap_init(struct memphy_struct *mram, int percent);
+int zswap_store(int swptyp, addr_t swpfpn, struct memphy_struct *src, addr_t srcfpn);
+int zswap_load(int swptyp, addr_t swpfpn, struct memphy_struct *dst, addr_t dstfpn);
+void zswap_invalidate(int swptyp, addr_t swpfpn);
+void zswap_report(void);
+void zswap_exit(void);
+
+/* Software TLB prototypes */
+void tlb_set_cpu(int cpuid);
+int tlb_lookup(struct mm_struct *mm, addr_t pgn, pte_t *pte);
+void tlb_insert(struct mm_struct *mm, addr_t pgn, pte_t pte);
+void tlb_flush_page(struct mm_struct *mm, addr_t pgn);
+void tlb_flush_mm(struct mm_struct *mm);
+void tlb_report(void);
+
+/* Same page merging prototypes */
+int ksm_init(struct memphy_struct *mram);
+int ksm_scan(void);
+int ksm_unmap(struct mm_struct *mm, addr_t pgn, addr_t fpn);
+int ksm_share(struct mm_struct *mm, addr_t pgn, addr_t fpn);
+int ksm_swap_out(addr_t fpn, int swptyp, addr_t swpfpn);
+int ksm_mapcount(addr_t fpn);
+void ksm_report(void);
+void ksm_exit(void);
+int ksmd_init(struct memphy_struct *mram, int interval);
+void ksmd_stop(void);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -166,4 +283,5 @@ int print_list_vma(struct vm_area_struct *rg);
 
 int print_list_pgn(struct pgn_t *ip);
 int print_pgtbl(struct pcb_t *ip, addr_t start, addr_t end);
+int print_mm_frames(struct pcb_t *caller);
 #endif
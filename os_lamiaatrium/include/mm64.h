@@ -5,8 +5,52 @@
 
 #define MM64_BITS_PER_LONG 64
 
-#define PAGING64_CPU_BUS_WIDTH 57 /* 57 bit bus - MAX SPACE 4MB */
-#define PAGING64_PAGESZ  4096      /* 4KB or 12-bits PAGE NUMBER */
+/* Table depth and page size come from os-cfg.h, 4KB pages over 5 levels
+ * by default. A table fills one frame of 8 byte entries, so each level
+ * resolves PAGE_SHIFT - 3 bits of the page number.
+ */
+#ifndef MM64_PGTBL_LEVELS
+#define MM64_PGTBL_LEVELS 5
+#endif
+#ifndef MM64_PAGE_SHIFT
+#define MM64_PAGE_SHIFT 12
+#endif
+
+#if MM64_PGTBL_LEVELS < 3 || MM64_PGTBL_LEVELS > 5
+#error "MM64_PGTBL_LEVELS must be 3, 4 or 5"
+#endif
+#if MM64_PAGE_SHIFT != 12 && MM64_PAGE_SHIFT != 14 && MM64_PAGE_SHIFT != 16
+#error "MM64_PAGE_SHIFT must be 12, 14 or 16 (4KB, 16KB or 64KB pages)"
+#endif
+
+#define PAGING64_ADDR_PT_SHIFT MM64_PAGE_SHIFT
+#define PAGING64_PAGESZ  (1 << PAGING64_ADDR_PT_SHIFT)
+#define PAGING64_PTESZ   8         /* a table frame holds PAGESZ / 8 entries */
+#define PAGING64_PTE_PER_PT (PAGING64_PAGESZ / PAGING64_PTESZ)
+
+/* Table levels, the PGD is level 0 and the PT the last one */
+#define PAGING64_LEVELS    MM64_PGTBL_LEVELS
+#define PAGING64_LEVEL_BITS (PAGING64_ADDR_PT_SHIFT - 3) /* index bits resolved per level */
+#define PAGING64_PMD_LEVEL (PAGING64_LEVELS - 2)
+#define PAGING64_PT_LEVEL  (PAGING64_LEVELS - 1)
+
+/* 39/48/57 bit spaces with 4KB pages */
+#define PAGING64_CPU_BUS_WIDTH (PAGING64_ADDR_PT_SHIFT + PAGING64_LEVELS * PAGING64_LEVEL_BITS)
+#if PAGING64_CPU_BUS_WIDTH > 64
+#error "MM64_PGTBL_LEVELS too deep for MM64_PAGE_SHIFT, the space exceeds 64 bits"
+#endif
+
+/* Lowest address bit of the table index at a level, and the index itself */
+#define PAGING64_LEVEL_SHIFT(level) \
+	(PAGING64_ADDR_PT_SHIFT + PAGING64_LEVEL_BITS * (PAGING64_PT_LEVEL - (level)))
+#define PAGING64_ADDR_IDX(addr, level) \
+	(((addr) >> PAGING64_LEVEL_SHIFT(level)) & (PAGING64_PTE_PER_PT - 1))
+#define PAGING64_PGN_IDX(pgn, level) \
+	(((pgn) >> (PAGING64_LEVEL_BITS * (PAGING64_PT_LEVEL - (level)))) & (PAGING64_PTE_PER_PT - 1))
+
+/* Huge page mapped by a PMD leaf, 2MB with 4KB pages */
+#define PAGING64_HUGESZ  BIT_ULL(PAGING64_LEVEL_SHIFT(PAGING64_PMD_LEVEL))
+#define PAGING64_HUGE_PGNUM (PAGING64_HUGESZ / PAGING64_PAGESZ)
 
 #define GENMASK64(h, l) \
 	(((~0ULL) << (l)) & (~0ULL >> (MM64_BITS_PER_LONG  - (h) - 1)))
@@ -14,56 +58,42 @@
 #define PAGING64_MAX_PGN  (DIV_ROUND_UP(BIT_ULL(21),PAGING64_PAGESZ))
 #define PAGING64_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz,PAGING64_PAGESZ)*PAGING64_PAGESZ)
 
+/* Page number and in-page offset of a virtual address */
+#define PAGING64_PGN(addr)   ((addr) >> PAGING64_ADDR_PT_SHIFT)
+#define PAGING64_OFFST(addr) ((addr) & (PAGING64_PAGESZ - 1))
+
 
 /* OFFSET */
-#define PAGING64_ADDR_OFFST_HIBIT 11
+#define PAGING64_ADDR_OFFST_HIBIT (PAGING64_ADDR_PT_SHIFT - 1)
 #define PAGING64_ADDR_OFFST_LOBIT 0
 
-/* PT */
-#define PAGING64_ADDR_PT_HIBIT 20
-#define PAGING64_ADDR_PT_LOBIT 12
-#define PAGING64_ADDR_PT_SHIFT 12
-
-/* PMD */
-#define PAGING64_ADDR_PMD_HIBIT 29
-#define PAGING64_ADDR_PMD_LOBIT 21
-
-/* PUD */
-#define PAGING64_ADDR_PUD_HIBIT 38
-#define PAGING64_ADDR_PUD_LOBIT 30
-
-/* P4D */
-#define PAGING64_ADDR_P4D_HIBIT 47
-#define PAGING64_ADDR_P4D_LOBIT 39
-
-/* PGD */
-#define PAGING64_ADDR_PGD_HIBIT 56
-#define PAGING64_ADDR_PGD_LOBIT 48
-
-/* Extract PGD Entry */
-#define PAGING64_ADDR_OFFST(addr) GETVAL(addr,PAGING_ADDR_OFFST_MASK,PAGING_ADDR_OFFST_LOBIT)
-#define PAGING64_ADDR_PT(addr)   ((addr&PAGING64_ADDR_PT_MASK)>>PAGING64_ADDR_PT_LOBIT)
-//GETVAL(addr,PAGING64_ADDR_PT_MASK,PAGING64_ADDR_PT_LOBIT)
-#define PAGING64_ADDR_PMD(addr)   ((addr&PAGING64_ADDR_PMD_MASK)>>PAGING64_ADDR_PMD_LOBIT)
-//GETVAL(addr,PAGING64_ADDR_PMD_MASK,PAGING64_ADDR_PMD_LOBIT)
-#define PAGING64_ADDR_PUD(addr)   ((addr&PAGING64_ADDR_PUD_MASK)>>PAGING64_ADDR_PUD_LOBIT)
-//GETVAL(addr,PAGING64_ADDR_PUD_MASK,PAGING64_ADDR_PUD_LOBIT)
-#define PAGING64_ADDR_P4D(addr)   ((addr&PAGING64_ADDR_P4D_MASK)>>PAGING64_ADDR_P4D_LOBIT)
-//GETVAL(addr,PAGING64_ADDR_P4D_MASK,PAGING64_ADDR_P4D_LOBIT)
-#define PAGING64_ADDR_PGD(addr)   ((addr&PAGING64_ADDR_PGD_MASK)>>PAGING64_ADDR_PGD_LOBIT)
-//GETVAL(addr,PAGING64_ADDR_PGD_MASK,PAGING64_ADDR_PGD_LOBIT)
-
-
-/* Masks */
-#define PAGING64_ADDR_OFFST_MASK  GENMASK64(PAGING_ADDR_OFFST_HIBIT,PAGING_ADDR_OFFST_LOBIT)
-#define PAGING64_ADDR_PT_MASK  GENMASK64(PAGING64_ADDR_PT_HIBIT,PAGING64_ADDR_PT_LOBIT)
-#define PAGING64_ADDR_PMD_MASK  GENMASK64(PAGING64_ADDR_PMD_HIBIT,PAGING64_ADDR_PMD_LOBIT)
-#define PAGING64_ADDR_PUD_MASK  GENMASK64(PAGING64_ADDR_PUD_HIBIT,PAGING64_ADDR_PUD_LOBIT)
-#define PAGING64_ADDR_P4D_MASK  GENMASK64(PAGING64_ADDR_P4D_HIBIT,PAGING64_ADDR_P4D_LOBIT)
-#define PAGING64_ADDR_PGD_MASK  GENMASK64(PAGING64_ADDR_PGD_HIBIT,PAGING64_ADDR_PGD_LOBIT)
+/* Table indexes of an address. The PGD, PMD and PT are always there, the
+ * PUD and P4D fold away in shorter tables.
+ */
+#define PAGING64_ADDR_PGD(addr)  PAGING64_ADDR_IDX(addr, 0)
+#define PAGING64_ADDR_P4D(addr)  (PAGING64_LEVELS > 4 ? PAGING64_ADDR_IDX(addr, PAGING64_PMD_LEVEL - 2) : 0)
+#define PAGING64_ADDR_PUD(addr)  (PAGING64_LEVELS > 3 ? PAGING64_ADDR_IDX(addr, PAGING64_PMD_LEVEL - 1) : 0)
+#define PAGING64_ADDR_PMD(addr)  PAGING64_ADDR_IDX(addr, PAGING64_PMD_LEVEL)
+#define PAGING64_ADDR_PT(addr)   PAGING64_ADDR_IDX(addr, PAGING64_PT_LEVEL)
+
+/*
+ * Callbacks of a sparse page table walk, any of them may be NULL. A non
+ * zero return stops the walk and is passed back to its caller.
+ */
+struct pgtbl_walk_ops {
+  /* Present PTE of a base page, pte_addr is where the PTE lives */
+  int (*pte_entry)(struct mm_struct *mm, addr_t pgn, pte_t pte, addr_t pte_addr, void *priv);
+  /* PMD leaf of a huge page, pgn is its first page */
+  int (*huge_entry)(struct mm_struct *mm, addr_t pgn, pte_t pmd, addr_t pmd_addr, void *priv);
+  /* Table frame, after its entries in the range were visited */
+  int (*table_exit)(struct mm_struct *mm, addr_t fpn, int level, void *priv);
+  void *priv;
+};
 
 //------------USER DEFINED FUNCTIONS PFP------------//
-addr_t get_32bit_entry(addr_t base_address, struct memphy_struct* mp);
+pte_t get_64bit_entry(addr_t base_address, struct memphy_struct* mp);
+int pgtbl_walk(struct mm_struct *mm, struct memphy_struct *mp, addr_t start_pgn, addr_t end_pgn,
+               const struct pgtbl_walk_ops *ops);
 int translate_address(struct mm_struct* mm, struct memphy_struct* mp, addr_t vaddr, addr_t* paddr); 
 int get_pte_address(struct mm_struct* mm, struct memphy_struct* mp, addr_t pgn, addr_t* pte_addr);
 void free_frame_list(struct pcb_t *caller, struct framephy_struct *frm_lst);
@@ -21,6 +21,55 @@
 #define IODUMP 1
 #define PAGETBL_DUMP 1
 
+/* MEMPHY storage on anonymous mmap, optionally with transparent huge pages */
+#define MEMPHY_MMAP 1
+//#define MEMPHY_THP 1
+
+/* Back each MEMSWP with a sparse file, name pattern takes the swap index */
+//#define MEMSWP_FILE "mswp%d.img"
+
+/* Model MEMSWP as sequential devices behind the elevator swap scheduler */
+//#define MEMSWP_SEQ 1
+
+/* Fill MEMSWP in index order like swap priorities, default is striping */
+//#define MEMSWP_PRIO_ORDER 1
+
+/* Compress swapped pages into a pool of MEMRAM frames before the MEMSWP */
+//#define MM_ZSWAP 1
+#define ZSWAP_POOL_PERCENT 10
+
+/* Background reclaim between low and high free MEMRAM watermarks (percent) */
+//#define MM_KSWAPD 1
+#define KSWAPD_WMARK_LOW 5
+#define KSWAPD_WMARK_HIGH 10
+
+/* Cache translations in a per CPU software TLB */
+#define MM_TLB 1
+
+/* Heap growth only reserves virtual space, a page gets its frame on first
+ * touch, along with the untouched pages of its MM_FAULT_AROUND page block
+ */
+#define MM_DEMAND_PAGING 1
+#define MM_FAULT_AROUND 16
+
+/* Map the 2MB aligned part of large heap growth with PMD level huge pages */
+#define MM_HUGEPAGE 1
+
+/* Under MM_DEMAND_PAGING, let the first touch of a fully reserved and
+ * unmapped 2MB chunk take a huge page (512 frames) instead of a page block
+ */
+//#define MM_HUGEPAGE_FAULT 1
+
+/* Page table depth (3, 4 or 5 levels) and page size (12, 14 or 16 bit
+ * offset) of the 64 bit mode, each level resolves page shift - 3 bits
+ */
+#define MM64_PGTBL_LEVELS 5
+#define MM64_PAGE_SHIFT 12
+
+/* Merge byte identical MEMRAM frames copy on write, scan period in usec */
+//#define MM_KSM 1
+#define KSM_SCAN_INTERVAL 500
+
 /* 
  * @bksysnet:
  *    The address mode must be explicitly define in MM64 or no-MM64
@@ -12,11 +12,27 @@
 #define OSMM_H
 
 #include <stdint.h>
+#include <sys/types.h> /* pthread_mutex_t, pthread.h would pull in include/sched.h */
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
 
+#define MEMPHY_MAX_CPUS 8    /* CPUs with a frame magazine, others use the device bitmap */
+#define MEMPHY_MAG_SZ 32     /* frames held per magazine */
+#define MEMPHY_MAG_BATCH 16  /* frames moved per refill/drain */
+#define MEMPHY_ZERO_POOL 32  /* pre-zeroed frames kept per device, at most */
+
+#define MEMSWP_IOQ_DEPTH 16  /* swap requests held before the elevator runs */
+
+#define TLB_MAX_CPUS MEMPHY_MAX_CPUS /* CPUs with a TLB, others walk the table */
+#define TLB_SETS 16
+#define TLB_WAYS 4
+
+#define PWC_ENTRIES 4        /* PT bases cached per address space */
+
+#define MEMPHY_RMAP_PGTBL ((addr_t)-1) /* rmap page number of a page table frame */
+
 /* 
  * @bksysnet: in long address mode of 64bit or original 32bit
  * the address type need to be redefined
@@ -28,8 +44,19 @@
 #define ADDR_TYPE uint32_t
 #endif
 
+/*
+ * Page table entries follow the address mode, a 64 bit PTE carries
+ * a frame number wide enough for any simulated RAM size
+ */
+#ifdef MM64
+#define PTE_TYPE uint64_t
+#else
+#define PTE_TYPE uint32_t
+#endif
+
 typedef char BYTE;
 typedef ADDR_TYPE addr_t;
+typedef PTE_TYPE pte_t;
 //typedef unsigned int uint32_t;
 
 
@@ -78,6 +105,15 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+/*
+ * Page walk cache entry, the PT base a PMD prefix resolved to
+ */
+struct pwc_entry_struct {
+   addr_t prefix;             /* page number without its PT index */
+   addr_t pt_base;
+   int valid;
+};
+
 /* 
  * Memory management struct
  */
@@ -103,6 +139,35 @@ struct mm_struct {
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Owner process, names frames in MEMPHY dumps and tags TLB entries */
+   uint32_t pid;
+
+   /* CPUs whose TLB may hold entries of this address space */
+   uint32_t tlb_cpumask;
+
+   /* Recently walked PT bases, valid until the tables are torn down */
+   struct pwc_entry_struct pwc[PWC_ENTRIES];
+   int pwc_next;
+};
+
+/*
+ * Software TLB of a CPU, caching the PTE of present pages
+ */
+struct tlb_entry_struct {
+   uint32_t asid;             /* address space ID, the owner pid */
+   addr_t pgn;
+   pte_t pte;
+   int valid;
+};
+
+struct tlb_struct {
+   struct tlb_entry_struct set[TLB_SETS][TLB_WAYS];
+   int next[TLB_SETS];        /* round robin victim way */
+
+   uint64_t nr_hit;
+   uint64_t nr_miss;
+   uint64_t nr_shootdown;     /* entries invalidated by PTE changes */
 };
 
 /*
@@ -116,18 +181,93 @@ struct framephy_struct {
    struct mm_struct* owner;
 };
 
+/*
+ * Per-CPU magazine of free frames in front of the device bitmap
+ */
+struct memphy_mag_struct {
+   int nr;
+   addr_t fpn[MEMPHY_MAG_SZ];
+   pthread_mutex_t lock;
+};
+
+/*
+ * Swap I/O request queued in front of a sequential device. A write keeps
+ * its page in the queue staging buffer, a read names the RAM frame to fill.
+ */
+struct memphy_ioreq_struct {
+   int rw;              /* 0 read into dstmp, 1 write from data */
+   addr_t swpfpn;
+   BYTE *data;
+   struct memphy_struct *dstmp;
+   addr_t dstfpn;
+};
+
+struct memphy_ioq_struct {
+   int nr;
+   int dir;             /* elevator direction, 1 toward higher frames */
+   struct memphy_ioreq_struct req[MEMSWP_IOQ_DEPTH];
+   BYTE *buf;           /* staging, one page per queue slot */
+
+   /* Statistics reported per device */
+   uint64_t nr_req;
+   uint64_t nr_dispatch; /* merged runs sent to the device */
+   uint64_t nr_hit;      /* reads served from a queued write */
+   pthread_mutex_t lock;
+};
+
+/*
+ * Reverse map entry of a frame: the mm mapping it and at which page.
+ * Free frames have a NULL mm, page table frames MEMPHY_RMAP_PGTBL.
+ */
+struct memphy_rmap_struct {
+   struct mm_struct *mm;
+   addr_t pgn;
+   uint32_t pid;        /* pid of mm, dumps never follow another mm */
+};
+
 struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
-   int maxsz;
+   addr_t maxsz;
+
+   /* Storage origin: mmapped or heap, fd of the backing file or -1 */
+   int mmapflg;
+   int fd;
    
    /* Sequential device fields */ 
    int rdmflg;
-   int cursor;
+   addr_t cursor;
+   uint64_t seek_dist; /* bytes the cursor travelled between accesses */
+   uint64_t nr_seek;
+
+   /* Management structure: one bit per frame, set while the frame is in use.
+    * fp_summary keeps one bit per fp_bitmap word, set while that word is full,
+    * so a free frame is found without scanning the whole bitmap.
+    */
+   int fpnum;
+   int free_fpnum;
+   int fp_hint;
+   uint64_t *fp_bitmap;
+   uint64_t *fp_summary;
+   pthread_mutex_t fp_lock;
+
+   /* Owner of each frame, fpnum entries */
+   struct memphy_rmap_struct *rmap;
+
+   /* Frames cached per CPU, refilled and drained in MEMPHY_MAG_BATCH */
+   struct memphy_mag_struct mags[MEMPHY_MAX_CPUS];
+   uint64_t *fp_cached;   /* held by a magazine or zero_fp, still used in fp_bitmap */
+
+   /* Frames already cleared for page tables and fresh pages, out of the
+    * bitmap but counted free, protected by fp_lock
+    */
+   addr_t zero_fp[MEMPHY_ZERO_POOL];
+   int zero_nr;
+   int zero_max;
+   uint64_t *fp_dirty;    /* handed out since the storage was mapped */
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   /* Swap I/O scheduler state, set up on first use of a sequential device */
+   struct memphy_ioq_struct *ioq;
 };
 
 #endif
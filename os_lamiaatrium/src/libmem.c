@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <time.h> /* unistd.h would clash with syscall() */
 
 static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -111,12 +112,20 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 #else
   regs.a3 = PAGING_PAGE_ALIGNSZ(size);
 #endif  
-  syscall(caller->krnl, caller->pid, 17, &regs); /* SYSCALL 17 sys_memmap */
+  if (syscall(caller->krnl, caller->pid, 17, &regs) != 0) /* SYSCALL 17 sys_memmap */
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
 
   /*Successful increase limit */
   caller->krnl->mm->symrgtbl[rgid].rg_start = old_sbrk;
   caller->krnl->mm->symrgtbl[rgid].rg_end = old_sbrk + size;
 
+  /* Keep the page aligned tail for the next allocations */
+  if (old_sbrk + size < cur_vma->sbrk)
+    enlist_vm_freerg_list(caller->krnl->mm, init_vm_rg(old_sbrk + size, cur_vma->sbrk));
+
   *alloc_addr = old_sbrk;
 
   pthread_mutex_unlock(&mmvm_lock);
@@ -212,6 +221,190 @@ printf("%s:%d\n",__func__,__LINE__);
   return 0;//val;
 }
 
+/*pg_evict_victim - swap a victim page out and hand over its frame
+ *@caller: caller
+ *@retfpn: return FPN of the freed frame
+ *
+ */
+int pg_evict_victim(struct pcb_t *caller, addr_t *retfpn)
+{
+  struct mm_struct *mm = caller->krnl->mm;
+  addr_t vicpgn, vicfpn, swpfpn;
+  pte_t vicpte;
+  int swptyp;
+
+retry:
+  /* Find victim page */
+  if (find_victim_page(mm, &vicpgn) == -1)
+    return -1;
+
+  vicpte = pte_get_entry(caller, vicpgn);
+  vicfpn = PAGING_FPN(vicpte);
+
+  /* Swapped out along with the other pages of a shared frame already */
+  if (!PAGING_PAGE_PRESENT(vicpte) || PAGING_PAGE_SWAPPED(vicpte))
+    goto retry;
+
+  /* Get free frame in MEMSWP, the swap device in use becomes active */
+  if (swap_get_slot(&swptyp, &swpfpn) == -1)
+  {
+    enlist_pgn_node(&mm->fifo_pgn, vicpgn);
+    return -1;
+  }
+  caller->krnl->active_mswp = swap_get_dev(swptyp);
+  caller->krnl->active_mswp_id = swptyp;
+
+  /* Copy victim frame to swap
+   * SWP(vicfpn --> swpfpn)
+   * Called straight rather than through SYSMEM_SWP_OP: kswapd evicts
+   * pages of processes that are not running, which the syscall
+   * cannot look up by pid.
+   */
+  if (__mm_swap_page(caller, vicfpn, swpfpn) != 0)
+  {
+    swap_free_slot(swptyp, swpfpn);
+    enlist_pgn_node(&mm->fifo_pgn, vicpgn);
+    return -1;
+  }
+
+  /* Update page table, the swap slot now belongs to the page */
+  pte_set_swap(caller, vicpgn, swptyp, swpfpn);
+  MEMPHY_set_rmap(caller->krnl->active_mswp, swpfpn, mm, vicpgn);
+
+  /* The other pages of a shared frame follow it to the same slot */
+  if (PAGING_PAGE_COW(vicpte) && ksm_unmap(mm, vicpgn, vicfpn) > 0)
+    ksm_swap_out(vicfpn, swptyp, swpfpn);
+  MEMPHY_set_rmap(caller->krnl->mram, vicfpn, NULL, 0);
+
+  *retfpn = vicfpn;
+  return 0;
+}
+
+/*pg_reclaim_frame - get a frame for the caller when MEMRAM has none free
+ *@caller: caller
+ *@retfpn: return FPN
+ *
+ * A victim of the caller first. kswapd may have swapped every resident
+ * page of the caller out for other processes, with its FIFO empty the
+ * frame is reclaimed from every registered process instead.
+ */
+int pg_reclaim_frame(struct pcb_t *caller, addr_t *retfpn)
+{
+  if (pg_evict_victim(caller, retfpn) == 0)
+    return 0;
+
+  kswapd_direct_reclaim(1);
+  return MEMPHY_get_freefp(caller->krnl->mram, retfpn);
+}
+
+#ifdef MM_DEMAND_PAGING
+/*pg_fault_around - map the untouched pages around a first touch
+ *@caller: caller
+ *@vma: vm area holding the page
+ *@pgn: PGN never touched before
+ *
+ * The run of never touched pages around pgn, inside its MM_FAULT_AROUND
+ * aligned block and the vm area, goes through vm_map_ram in one batch.
+ * Only done while MEMRAM has the frames, no page is evicted for it.
+ */
+static int pg_fault_around(struct pcb_t *caller, struct vm_area_struct *vma, addr_t pgn)
+{
+  struct vm_rg_struct rg;
+#ifdef MM64
+  addr_t pgsz = PAGING64_PAGESZ;
+#else
+  addr_t pgsz = PAGING_PAGESZ;
+#endif
+  addr_t first = pgn - pgn % MM_FAULT_AROUND;
+  addr_t last = first + MM_FAULT_AROUND - 1;
+  addr_t lo = pgn, hi = pgn;
+
+  if (first < vma->vm_start / pgsz)
+    first = vma->vm_start / pgsz;
+  if (last >= vma->vm_end / pgsz)
+    last = vma->vm_end / pgsz - 1;
+
+  /* A PTE of 0 was never present nor swapped out */
+  while (lo > first && pte_get_entry(caller, lo - 1) == 0)
+    lo--;
+  while (hi < last && pte_get_entry(caller, hi + 1) == 0)
+    hi++;
+
+  /* Counting the tables a fresh walk may have to allocate */
+  if (lo == hi || MEMPHY_nr_freefp(caller->krnl->mram) < (int)(hi - lo + 1) + 4)
+    return -1;
+
+  return vm_map_ram(caller, vma->vm_start, vma->vm_end, lo * pgsz,
+                    hi - lo + 1, &rg) == 0 ? 0 : -1;
+}
+
+/*pg_fault_anon - give a reserved page its first frame
+ *@caller: caller
+ *@pgn: PGN never touched before
+ *
+ * The page has to lie inside a vm area, else the access is bad. The
+ * untouched pages around it are mapped along when MEMRAM has room, with
+ * MM_HUGEPAGE_FAULT a whole reserved and unmapped huge page aligned chunk
+ * takes a huge page instead. Otherwise the page alone gets a zero filled
+ * frame, taken from a victim page when MEMRAM is full.
+ */
+static int pg_fault_anon(struct pcb_t *caller, addr_t pgn)
+{
+  struct mm_struct *mm = caller->krnl->mm;
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct vm_area_struct *vma;
+  addr_t fpn, vicfpn;
+#ifdef MM64
+  addr_t addr = pgn * PAGING64_PAGESZ;
+#else
+  addr_t addr = pgn * PAGING_PAGESZ;
+#endif
+
+  for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+  {
+    if (addr >= vma->vm_start && addr < vma->vm_end)
+      break;
+  }
+  if (vma == NULL)
+    return -1;
+
+#if defined(MM64) && defined(MM_HUGEPAGE) && defined(MM_HUGEPAGE_FAULT)
+  addr_t hstart = addr & ~(PAGING64_HUGESZ - 1);
+
+  if (hstart >= vma->vm_start && hstart + PAGING64_HUGESZ <= vma->vm_end &&
+      vmap_huge_range(caller, hstart, 1) == 1)
+    return 0;
+#endif
+
+  if (pg_fault_around(caller, vma, pgn) == 0)
+    return 0;
+
+  if (MEMPHY_get_zerofp(mram, &fpn) != 0)
+  {
+    if (pg_reclaim_frame(caller, &fpn) != 0)
+      return -1;
+    MEMPHY_clear_frame(mram, fpn);
+  }
+
+  /* Tables missing on the way take frames too, evict until they fit */
+  while (pte_set_fpn(caller, pgn, fpn) != 0)
+  {
+    if (pg_reclaim_frame(caller, &vicfpn) != 0)
+    {
+      MEMPHY_put_freefp(mram, fpn);
+      return -1;
+    }
+    MEMPHY_put_freefp(mram, vicfpn);
+  }
+  kswapd_wakeup();
+
+  MEMPHY_set_rmap(mram, fpn, mm, pgn);
+  enlist_pgn_node(&mm->fifo_pgn, pgn);
+
+  return 0;
+}
+#endif
+
 /*pg_getpage - get the page in ram
  *@mm: memory region
  *@pagenum: PGN
@@ -222,49 +415,103 @@ printf("%s:%d\n",__func__,__LINE__);
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
 {
 
-  uint32_t pte = pte_get_entry(caller, pgn);
+  pte_t pte = pte_get_entry(caller, pgn);
 
   if (!PAGING_PAGE_PRESENT(pte))
-  { /* Page is not online, make it actively living */
-    addr_t vicpgn, swpfpn;
-//    addr_t vicfpn;
-//    addr_t vicpte;
-//  struct sc_regs regs;
+  {
+#ifdef MM_DEMAND_PAGING
+    /* First touch of a reserved page */
+    if (pg_fault_anon(caller, pgn) != 0)
+      return -1;
+    pte = pte_get_entry(caller, pgn);
+#else
+    return -1; /* page was never mapped */
+#endif
+  }
 
-    /* TODO Initialize the target frame storing our variable */
-//  addr_t tgtfpn 
+  if (PAGING_PAGE_SWAPPED(pte))
+  { /* Page is not online, make it actively living */
+    addr_t tgtfpn, tgtswpfpn;
 
-    /* TODO: Play with your paging theory here */
-    /* Find victim page */
-    if (find_victim_page(caller->krnl->mm, &vicpgn) == -1)
-    {
+    /* Initialize the target frame storing our variable, a free frame
+     * if RAM still has one, else the frame of a victim page
+     */
+    if (MEMPHY_get_freefp(caller->krnl->mram, &tgtfpn) != 0 &&
+        pg_reclaim_frame(caller, &tgtfpn) != 0)
       return -1;
-    }
+    kswapd_wakeup();
 
-    /* Get free frame in MEMSWP */
-    if (MEMPHY_get_freefp(caller->krnl->active_mswp, &swpfpn) == -1)
+    /* Copy target page from swap, its swap frame is free afterwards
+     * SWP(tgtswpfpn --> tgtfpn)
+     */
+    tgtswpfpn = PAGING_SWP(pte);
+    if (swap_read_slot(PAGING_SWPTYP(pte), tgtswpfpn, caller->krnl->mram, tgtfpn) != 0)
     {
+      MEMPHY_put_freefp(caller->krnl->mram, tgtfpn);
       return -1;
     }
+    swap_free_slot(PAGING_SWPTYP(pte), tgtswpfpn);
 
-    /* TODO: Implement swap frame from MEMRAM to MEMSWP and vice versa*/
+    /* Update its online status of the target page */
+    pte_set_fpn(caller, pgn, tgtfpn);
+    MEMPHY_set_rmap(caller->krnl->mram, tgtfpn, caller->krnl->mm, pgn);
 
-    /* TODO copy victim frame to swap 
-     * SWP(vicfpn <--> swpfpn)
-     * SYSCALL 1 sys_memmap
-     */
+    enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn);
+  }
 
+  *fpn = PAGING_FPN(pte_get_entry(caller,pgn));
 
-    /* Update page table */
-    //pte_set_swap(...);
+  return 0;
+}
 
-    /* Update its online status of the target page */
-    //pte_set_fpn(...);
+/*pg_break_cow - give a page on a shared frame its own copy
+ *@caller: caller
+ *@pgn: PGN
+ *@fpn: shared FPN, return the private FPN
+ *
+ * Return 1 when getting a frame swapped the page itself out, the caller
+ * then faults it back in as a private page.
+ */
+static int pg_break_cow(struct pcb_t *caller, int pgn, int *fpn)
+{
+  struct mm_struct *mm = caller->krnl->mm;
+  struct memphy_struct *mram = caller->krnl->mram;
+  addr_t newfpn;
+  pte_t pte;
 
-    enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn);
+  /* The last page on the frame simply takes it over */
+  if (ksm_mapcount(*fpn) <= 1)
+  {
+    ksm_unmap(mm, pgn, *fpn);
+    pte_set_fpn(caller, pgn, *fpn);
+    MEMPHY_set_rmap(mram, *fpn, mm, pgn);
+    return 0;
   }
 
-  *fpn = PAGING_FPN(pte_get_entry(caller,pgn));
+  if (MEMPHY_get_freefp(mram, &newfpn) != 0 &&
+      pg_reclaim_frame(caller, &newfpn) != 0)
+    return -1;
+
+  pte = pte_get_entry(caller, pgn);
+  if (PAGING_PAGE_SWAPPED(pte) || !PAGING_PAGE_COW(pte))
+  {
+    MEMPHY_put_freefp(mram, newfpn);
+    return 1;
+  }
+
+  if (__swap_cp_page(mram, *fpn, mram, newfpn) != 0)
+  {
+    MEMPHY_put_freefp(mram, newfpn);
+    return -1;
+  }
+
+  /* Eviction above may have left this page the only one on the frame */
+  if (ksm_unmap(mm, pgn, *fpn) == 0)
+    MEMPHY_put_freefp(mram, *fpn);
+
+  pte_set_fpn(caller, pgn, newfpn);
+  MEMPHY_set_rmap(mram, newfpn, mm, pgn);
+  *fpn = newfpn;
 
   return 0;
 }
@@ -277,20 +524,34 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
  */
 int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
 {
+#ifdef MM64
+  int pgn = PAGING64_PGN(addr);
+  int off = PAGING64_OFFST(addr);
+#else
   int pgn = PAGING_PGN(addr);
-//  int off = PAGING_OFFST(addr);
+  int off = PAGING_OFFST(addr);
+#endif
   int fpn;
+  struct sc_regs regs;
 
   if (pg_getpage(mm, pgn, &fpn, caller) != 0)
     return -1; /* invalid page access */
 
-//  int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+#ifdef MM64
+  addr_t phyaddr = (addr_t)fpn * PAGING64_PAGESZ + off;
+#else
+  addr_t phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+#endif
 
-  /* TODO 
-   *  MEMPHY_read(caller->krnl->mram, phyaddr, data);
-   *  MEMPHY READ 
-   *  SYSCALL 17 sys_memmap with SYSMEM_IO_READ
+  /* MEMPHY READ
+   * SYSCALL 17 sys_memmap with SYSMEM_IO_READ
    */
+  regs.a1 = SYSMEM_IO_READ;
+  regs.a2 = phyaddr;
+  if (syscall(caller->krnl, caller->pid, 17, &regs) != 0)
+    return -1;
+
+  *data = (BYTE)regs.a3;
 
   return 0;
 }
@@ -303,20 +564,46 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
  */
 int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
 {
+#ifdef MM64
+  int pgn = PAGING64_PGN(addr);
+  int off = PAGING64_OFFST(addr);
+#else
   int pgn = PAGING_PGN(addr);
-//  int off = PAGING_OFFST(addr);
-  int fpn;
+  int off = PAGING_OFFST(addr);
+#endif
+  int fpn, ret;
+  struct sc_regs regs;
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
-    return -1; /* invalid page access */
+  /* Get the page to MEMRAM, swap from MEMSWAP if needed, and copy it
+   * out of a shared frame before the write
+   */
+  do
+  {
+    if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+      return -1; /* invalid page access */
+
+    ret = 0;
+    if (PAGING_PAGE_COW(pte_get_entry(caller, pgn)))
+      ret = pg_break_cow(caller, pgn, &fpn);
+  } while (ret > 0);
+
+  if (ret < 0)
+    return -1;
 
+#ifdef MM64
+  addr_t phyaddr = (addr_t)fpn * PAGING64_PAGESZ + off;
+#else
+  addr_t phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+#endif
 
-  /* TODO 
-   *  MEMPHY_write(caller->krnl->mram, phyaddr, value);
-   *  MEMPHY WRITE with SYSMEM_IO_WRITE 
+  /* MEMPHY WRITE with SYSMEM_IO_WRITE
    * SYSCALL 17 sys_memmap
    */
+  regs.a1 = SYSMEM_IO_WRITE;
+  regs.a2 = phyaddr;
+  regs.a3 = value;
+  if (syscall(caller->krnl, caller->pid, 17, &regs) != 0)
+    return -1;
 
   return 0;
 }
@@ -331,14 +618,24 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
  */
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data)
 {
+  pthread_mutex_lock(&mmvm_lock);
   struct vm_rg_struct *currg = get_symrg_byid(caller->krnl->mm, rgid);
 
-//  struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
 
-  /* TODO Invalid memory identify */
+  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
 
-  pg_getval(caller->krnl->mm, currg->rg_start + offset, data, caller);
+  if (pg_getval(caller->krnl->mm, currg->rg_start + offset, data, caller) != 0)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1; /* No frame for the page */
+  }
 
+  pthread_mutex_unlock(&mmvm_lock);
   return 0;
 }
 
@@ -351,12 +648,20 @@ int libread(
 {
   BYTE data;
   int val = __read(proc, 0, source, offset, &data);
+  if (val == -1)
+  {
+    return -1;
+  }
 
   *destination = data;
 #ifdef IODUMP
-  /* TODO dump IO content (if needed) */
+  printf("PID=%d read region=%d offset=%lu value=%d\n",
+         proc->pid, source, (unsigned long)offset, data);
 #ifdef PAGETBL_DUMP
+  /* kswapd may be changing the table, read it like a fault would */
+  pthread_mutex_lock(&mmvm_lock);
   print_pgtbl(proc, 0, -1); // print max TBL
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
 #endif
 
@@ -384,7 +689,11 @@ int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value
     return -1;
   }
 
-  pg_setval(caller->krnl->mm, currg->rg_start + offset, value, caller);
+  if (pg_setval(caller->krnl->mm, currg->rg_start + offset, value, caller) != 0)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1; /* No frame for the page */
+  }
 
   pthread_mutex_unlock(&mmvm_lock);
   return 0;
@@ -403,10 +712,14 @@ int libwrite(
     return -1;
   }
 #ifdef IODUMP
+  /* kswapd and other processes may be changing tables and frames */
+  pthread_mutex_lock(&mmvm_lock);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
-  MEMPHY_dump(proc->krnl->mram);
+  /* Only the frames of the writer, zero content is skipped */
+  print_mm_frames(proc);
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
 
   return val;
@@ -414,32 +727,59 @@ int libwrite(
 
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *
+ * The page table is walked once, frames and swap slots go back in
+ * runs, then the mm of the finished process is released.
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
+  struct mm_struct *mm = caller->krnl->mm;
+
+  if (mm == NULL)
+    return 0;
+
   pthread_mutex_lock(&mmvm_lock);
-  int pagenum, fpn;
-  uint32_t pte;
+  exit_mm(mm, caller->krnl->mram);
+  pthread_mutex_unlock(&mmvm_lock);
 
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
-  {
-    pte = caller->krnl->mm->pgd[pagenum];
+  free(mm);
+  caller->krnl->mm = NULL;
+  return 0;
+}
 
-    if (PAGING_PAGE_PRESENT(pte))
-    {
-      fpn = PAGING_FPN(pte);
-      MEMPHY_put_freefp(caller->krnl->mram, fpn);
-    }
-    else
+/*dup_pcb_memph - give a forked process the memory of its parent
+ *@caller: parent
+ *@child: forked process, its krnl set up from the parent one
+ *
+ * The pages are shared copy on write, see dup_mm. Only the tables of the
+ * child take frames, when MEMRAM runs out of them a page of the parent
+ * is evicted and the copy starts over.
+ */
+int dup_pcb_memph(struct pcb_t *caller, struct pcb_t *child)
+{
+  struct mm_struct *mm = malloc(sizeof(struct mm_struct));
+  struct memphy_struct *mram = child->krnl->mram;
+  addr_t fpn;
+
+  child->krnl->mm = mm;
+  if (mm == NULL)
+    return -1;
+
+  pthread_mutex_lock(&mmvm_lock);
+  while (init_mm(mm, child) != 0 || dup_mm(caller->krnl->mm, mm, mram) != 0)
+  {
+    exit_mm(mm, mram);
+    if (pg_reclaim_frame(caller, &fpn) != 0)
     {
-      fpn = PAGING_SWP(pte);
-      MEMPHY_put_freefp(caller->krnl->active_mswp, fpn);
+      pthread_mutex_unlock(&mmvm_lock);
+      free(mm);
+      child->krnl->mm = NULL;
+      return -1;
     }
+    MEMPHY_put_freefp(mram, fpn);
   }
-
   pthread_mutex_unlock(&mmvm_lock);
+
   return 0;
 }
 
@@ -465,13 +805,333 @@ int find_victim_page(struct mm_struct *mm, addr_t *retpgn)
     pg = pg->pg_next;
   }
   *retpgn = pg->pgn;
-  prev->pg_next = NULL;
+  if (prev != NULL)
+    prev->pg_next = NULL;
+  else
+    mm->fifo_pgn = NULL;
 
   free(pg);
 
   return 0;
 }
 
+/*
+ * kswapd - background page reclaim
+ *
+ * When MEMRAM free frames drop below the low watermark the kswapd thread
+ * evicts FIFO victims, round robin over every registered process, until
+ * the high watermark is back. Fault and alloc paths then find a free frame
+ * without evicting inline. The registry, the reclaim itself and the
+ * kswapd_mram the others check it is running by are protected by
+ * mmvm_lock, like every other page table change.
+ */
+struct kswapd_proc {
+  struct pcb_t *proc;
+  struct kswapd_proc *next;
+};
+
+static struct memphy_struct *kswapd_mram;
+static struct kswapd_proc *kswapd_procs;
+static struct kswapd_proc *kswapd_cursor;
+static int kswapd_low, kswapd_high;
+static int kswapd_pending, kswapd_stopped;
+static unsigned long kswapd_nr_wakeup, kswapd_nr_reclaim, kswapd_nr_direct;
+static pthread_t kswapd_thread;
+static pthread_mutex_t kswapd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kswapd_cond = PTHREAD_COND_INITIALIZER;
+
+/*__kswapd_reclaim - evict up to nr pages, mmvm_lock held
+ *@nr: number of frames wanted
+ *
+ */
+int __kswapd_reclaim(int nr)
+{
+  struct kswapd_proc *start;
+  addr_t fpn;
+  int done = 0, progress = 0;
+
+  if (kswapd_mram == NULL || kswapd_procs == NULL)
+    return 0;
+
+  if (kswapd_cursor == NULL)
+    kswapd_cursor = kswapd_procs;
+  start = kswapd_cursor;
+
+  /* One victim per process per turn, stop after a turn with no victim */
+  while (done < nr)
+  {
+    if (pg_evict_victim(kswapd_cursor->proc, &fpn) == 0)
+    {
+      MEMPHY_put_freefp(kswapd_mram, fpn);
+      done++;
+      progress = 1;
+    }
+
+    kswapd_cursor = (kswapd_cursor->next != NULL) ? kswapd_cursor->next : kswapd_procs;
+    if (kswapd_cursor == start)
+    {
+      if (!progress)
+        break;
+      progress = 0;
+    }
+  }
+
+  kswapd_nr_reclaim += done;
+  return done;
+}
+
+/*kswapd_wakeup - kick kswapd when MEMRAM runs below its low watermark, mmvm_lock held
+ *
+ */
+void kswapd_wakeup(void)
+{
+  if (kswapd_mram == NULL || MEMPHY_nr_freefp(kswapd_mram) >= kswapd_low)
+    return;
+
+  pthread_mutex_lock(&kswapd_lock);
+  kswapd_pending = 1;
+  pthread_cond_signal(&kswapd_cond);
+  pthread_mutex_unlock(&kswapd_lock);
+}
+
+/*kswapd_direct_reclaim - reclaim in the caller context, mmvm_lock held
+ *@nr: number of free frames the caller needs
+ *
+ */
+int kswapd_direct_reclaim(int nr)
+{
+  int nfree;
+
+  if (kswapd_mram == NULL)
+    return 0;
+
+  nfree = MEMPHY_nr_freefp(kswapd_mram);
+  if (nfree >= nr)
+    return 0;
+
+  kswapd_nr_direct++;
+  return __kswapd_reclaim(nr - nfree);
+}
+
+static void *kswapd_routine(void *arg)
+{
+  struct memphy_struct *mram = arg;
+  int nfree;
+
+  while (1)
+  {
+    pthread_mutex_lock(&kswapd_lock);
+    while (!kswapd_pending && !kswapd_stopped)
+      pthread_cond_wait(&kswapd_cond, &kswapd_lock);
+    if (kswapd_stopped)
+    {
+      pthread_mutex_unlock(&kswapd_lock);
+      break;
+    }
+    kswapd_pending = 0;
+    kswapd_nr_wakeup++;
+    pthread_mutex_unlock(&kswapd_lock);
+
+    pthread_mutex_lock(&mmvm_lock);
+    nfree = MEMPHY_nr_freefp(mram);
+    if (nfree < kswapd_high)
+      __kswapd_reclaim(kswapd_high - nfree);
+    pthread_mutex_unlock(&mmvm_lock);
+
+    /* Clear frames now rather than in the next fault, leaving the
+     * frames below the low watermark to the faulting processes
+     */
+    MEMPHY_zero_refill(mram, kswapd_low);
+  }
+
+  return NULL;
+}
+
+/*kswapd_init - start kswapd on a MEMRAM
+ *@mram: MEMRAM device
+ *@low: low watermark, in percent of the frames
+ *@high: high watermark, in percent of the frames
+ *
+ */
+int kswapd_init(struct memphy_struct *mram, int low, int high)
+{
+  kswapd_low = mram->fpnum * low / 100;
+  kswapd_high = mram->fpnum * high / 100;
+  if (kswapd_low < 1)
+    kswapd_low = 1;
+  if (kswapd_high <= kswapd_low)
+    kswapd_high = kswapd_low + 1;
+
+  kswapd_stopped = 0;
+
+  if (pthread_create(&kswapd_thread, NULL, kswapd_routine, mram) != 0)
+    return -1;
+
+  pthread_mutex_lock(&mmvm_lock);
+  kswapd_mram = mram;
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return 0;
+}
+
+/*kswapd_stop - stop kswapd and print what it did
+ *
+ */
+void kswapd_stop(void)
+{
+  struct kswapd_proc *kp;
+
+  pthread_mutex_lock(&mmvm_lock);
+  if (kswapd_mram == NULL)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return;
+  }
+  kswapd_mram = NULL;
+  pthread_mutex_unlock(&mmvm_lock);
+
+  pthread_mutex_lock(&kswapd_lock);
+  kswapd_stopped = 1;
+  pthread_cond_signal(&kswapd_cond);
+  pthread_mutex_unlock(&kswapd_lock);
+  pthread_join(kswapd_thread, NULL);
+
+  if (kswapd_nr_reclaim > 0)
+    printf("KSWAPD: watermarks %d/%d frames, %lu wakeups, %lu direct, %lu pages reclaimed\n",
+           kswapd_low, kswapd_high, kswapd_nr_wakeup, kswapd_nr_direct, kswapd_nr_reclaim);
+
+  pthread_mutex_lock(&mmvm_lock);
+  while ((kp = kswapd_procs) != NULL)
+  {
+    kswapd_procs = kp->next;
+    free(kp);
+  }
+  kswapd_cursor = NULL;
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/*kswapd_register - make the pages of a process reclaimable
+ *@proc: process
+ *
+ */
+int kswapd_register(struct pcb_t *proc)
+{
+  struct kswapd_proc *kp;
+
+  pthread_mutex_lock(&mmvm_lock);
+  if (kswapd_mram == NULL)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return 0;
+  }
+
+  kp = malloc(sizeof(struct kswapd_proc));
+  if (kp == NULL)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
+
+  kp->proc = proc;
+  kp->next = kswapd_procs;
+  kswapd_procs = kp;
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return 0;
+}
+
+/*kswapd_unregister - forget a process before it goes away
+ *@proc: process
+ *
+ */
+void kswapd_unregister(struct pcb_t *proc)
+{
+  struct kswapd_proc **pp, *kp;
+
+  /* Nothing is registered while kswapd is not running */
+  pthread_mutex_lock(&mmvm_lock);
+  for (pp = &kswapd_procs; *pp != NULL; pp = &(*pp)->next)
+  {
+    if ((*pp)->proc != proc)
+      continue;
+
+    kp = *pp;
+    *pp = kp->next;
+    if (kswapd_cursor == kp)
+      kswapd_cursor = kp->next;
+    free(kp);
+    break;
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/*
+ * ksmd - same page merging in the background
+ *
+ * Runs a ksm_scan pass every interval usec under mmvm_lock.
+ */
+static pthread_t ksmd_thread;
+static int ksmd_interval, ksmd_running, ksmd_stopped;
+static pthread_mutex_t ksmd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ksmd_cond = PTHREAD_COND_INITIALIZER;
+
+static void *ksmd_routine(void *arg)
+{
+  struct timespec ts;
+
+  pthread_mutex_lock(&ksmd_lock);
+  while (!ksmd_stopped)
+  {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += (long)ksmd_interval * 1000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+    if (pthread_cond_timedwait(&ksmd_cond, &ksmd_lock, &ts) == 0)
+      continue; /* woken to stop */
+
+    pthread_mutex_unlock(&ksmd_lock);
+    pthread_mutex_lock(&mmvm_lock);
+    ksm_scan();
+    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_lock(&ksmd_lock);
+  }
+  pthread_mutex_unlock(&ksmd_lock);
+
+  return NULL;
+}
+
+/*ksmd_init - start merging the frames of a MEMRAM
+ *@mram: MEMRAM device, set up by ksm_init already
+ *@interval: usec between two scan passes
+ *
+ */
+int ksmd_init(struct memphy_struct *mram, int interval)
+{
+  ksmd_interval = interval;
+  ksmd_stopped = 0;
+  if (pthread_create(&ksmd_thread, NULL, ksmd_routine, NULL) != 0)
+    return -1;
+
+  ksmd_running = 1;
+  return 0;
+}
+
+/*ksmd_stop - stop the scanner, shared frames stay mapped
+ *
+ */
+void ksmd_stop(void)
+{
+  if (!ksmd_running)
+    return;
+
+  pthread_mutex_lock(&ksmd_lock);
+  ksmd_stopped = 1;
+  pthread_cond_signal(&ksmd_cond);
+  pthread_mutex_unlock(&ksmd_lock);
+  pthread_join(ksmd_thread, NULL);
+  ksmd_running = 0;
+}
+
 /*get_free_vmrg_area - get a free vm region
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
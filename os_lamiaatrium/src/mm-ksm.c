@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Same page merging mm/mm-ksm.c
+ *
+ * A scan pass checksums every mapped MEMRAM frame. A frame whose checksum
+ * did not change since the previous pass is stable and gets merged with a
+ * byte identical frame: either a shared frame already known, or another
+ * stable frame met earlier in the same pass. Every page mapping a shared
+ * frame has its PTE marked copy on write, the first write copies the
+ * frame back to a private one. Fork shares the frames of the parent with
+ * its child through the same nodes.
+ *
+ * Shared frames have no owner in the MEMPHY reverse map, their mappers
+ * are listed in the shared node instead. All calls run under mmvm_lock.
+ */
+
+#include "mm64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MM64
+#define KSM_PAGESZ PAGING64_PAGESZ
+#else
+#define KSM_PAGESZ PAGING_PAGESZ
+#endif
+
+#define KSM_HSIZE 256
+
+struct ksm_rmap_item {
+   struct mm_struct *mm;
+   addr_t pgn;
+   struct ksm_rmap_item *next;
+};
+
+/* A shared frame and every page mapping it */
+struct ksm_node {
+   addr_t fpn;
+   uint32_t cksum;
+   int nr_map;
+   struct ksm_rmap_item *maps;
+   struct ksm_node *next;
+};
+
+static struct {
+   struct memphy_struct *mram;
+   uint32_t *cksum;          /* per frame checksum at the previous pass */
+   struct ksm_node **node;   /* per frame shared node, NULL if private */
+   struct ksm_node *htab[KSM_HSIZE];
+
+   /* Stable frames met in the current pass, chained by checksum */
+   int *unstable_head;
+   int *unstable_next;
+
+   uint64_t nr_pass;
+   uint64_t nr_merge;
+   uint64_t nr_unshare;
+   uint64_t nr_shared;       /* shared frames now */
+   uint64_t nr_sharing;      /* pages mapping them now */
+   uint64_t max_saved;       /* peak frames saved */
+} ksm;
+
+/*
+ *  ksm_checksum - FNV-1a over the words of a page
+ */
+static uint32_t ksm_checksum(const BYTE *page)
+{
+   const uint64_t *w = (const uint64_t *)page;
+   uint64_t h = 0xcbf29ce484222325ULL;
+   int i;
+
+   for (i = 0; i < KSM_PAGESZ / 8; i++)
+      h = (h ^ w[i]) * 0x100000001b3ULL;
+
+   return (uint32_t)(h ^ (h >> 32));
+}
+
+/*
+ *  ksm_remap - point a present PTE at another frame, copy on write
+ *  @mm: owner of the page
+ *  @pgn: page number
+ *  @oldfpn: frame the page must be mapping now
+ *  @newfpn: shared frame
+ */
+static int ksm_remap(struct mm_struct *mm, addr_t pgn, addr_t oldfpn, addr_t newfpn)
+{
+   addr_t pte_addr;
+   uint64_t pte;
+
+   if (get_pte_address(mm, ksm.mram, pgn, &pte_addr) != 0 ||
+       MEMPHY_read64(ksm.mram, pte_addr, &pte) != 0)
+      return -1;
+
+   if (!PAGING_PAGE_PRESENT(pte) || PAGING_PAGE_SWAPPED(pte) || PAGING_FPN(pte) != oldfpn)
+      return -1;
+
+   SETVAL(pte, newfpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+   SETBIT(pte, PAGING_PTE_COW_MASK);
+   if (MEMPHY_write64(ksm.mram, pte_addr, pte) != 0)
+      return -1;
+
+   tlb_flush_page(mm, pgn);
+   return 0;
+}
+
+/*
+ *  ksm_add_map - merge a private frame into a shared node
+ *  @n: shared node
+ *  @fpn: private frame, freed on success
+ */
+static int ksm_add_map(struct ksm_node *n, addr_t fpn)
+{
+   struct ksm_rmap_item *it;
+   struct mm_struct *mm;
+   addr_t pgn;
+
+   mm = MEMPHY_get_rmap(ksm.mram, fpn, &pgn);
+   if (mm == NULL)
+      return -1;
+
+   it = malloc(sizeof(struct ksm_rmap_item));
+   if (it == NULL)
+      return -1;
+
+   if (ksm_remap(mm, pgn, fpn, n->fpn) != 0)
+   {
+      free(it);
+      return -1;
+   }
+
+   it->mm = mm;
+   it->pgn = pgn;
+   it->next = n->maps;
+   n->maps = it;
+   n->nr_map++;
+   ksm.nr_sharing++;
+
+   if (fpn != n->fpn)
+   {
+      MEMPHY_put_freefp(ksm.mram, fpn);
+      ksm.nr_merge++;
+   }
+   else
+   {
+      MEMPHY_set_rmap(ksm.mram, fpn, NULL, 0);
+   }
+
+   return 0;
+}
+
+/*
+ *  ksm_same - compare two frames
+ */
+static int ksm_same(addr_t a, addr_t b)
+{
+   return memcmp(ksm.mram->storage + a * KSM_PAGESZ,
+                 ksm.mram->storage + b * KSM_PAGESZ, KSM_PAGESZ) == 0;
+}
+
+/*
+ *  ksm_init - set up merging on a MEMRAM
+ *  @mram: MEMRAM device
+ */
+int ksm_init(struct memphy_struct *mram)
+{
+   int nfp = mram->fpnum;
+
+   ksm.cksum = calloc(nfp, sizeof(uint32_t));
+   ksm.node = calloc(nfp, sizeof(struct ksm_node *));
+   ksm.unstable_head = malloc(KSM_HSIZE * sizeof(int));
+   ksm.unstable_next = malloc(nfp * sizeof(int));
+   if (ksm.cksum == NULL || ksm.node == NULL ||
+       ksm.unstable_head == NULL || ksm.unstable_next == NULL)
+   {
+      ksm_exit();
+      return -1;
+   }
+
+   ksm.mram = mram;
+   return 0;
+}
+
+/*
+ *  ksm_scan - one scan pass over MEMRAM, mmvm_lock held
+ *
+ *  Return the number of frames given back.
+ */
+int ksm_scan(void)
+{
+   BYTE page[KSM_PAGESZ];
+   struct ksm_node *n;
+   struct mm_struct *mm;
+   uint64_t merged = ksm.nr_merge;
+   addr_t fpn, pgn;
+   uint32_t ck;
+   int u, h;
+
+   if (ksm.mram == NULL)
+      return 0;
+
+   for (h = 0; h < KSM_HSIZE; h++)
+      ksm.unstable_head[h] = -1;
+
+   for (fpn = 0; fpn < ksm.mram->fpnum; fpn++)
+   {
+      /* Only private data pages, shared and table frames have no rmap page */
+      mm = MEMPHY_get_rmap(ksm.mram, fpn, &pgn);
+      if (mm == NULL || pgn == MEMPHY_RMAP_PGTBL)
+         continue;
+
+      if (MEMPHY_read_block(ksm.mram, fpn * KSM_PAGESZ, page, KSM_PAGESZ) != 0)
+         continue;
+
+      /* A frame still being written is not worth merging */
+      ck = ksm_checksum(page);
+      if (ck != ksm.cksum[fpn])
+      {
+         ksm.cksum[fpn] = ck;
+         continue;
+      }
+      h = ck % KSM_HSIZE;
+
+      for (n = ksm.htab[h]; n != NULL; n = n->next)
+         if (n->cksum == ck && ksm_same(n->fpn, fpn))
+            break;
+
+      if (n != NULL)
+      {
+         ksm_add_map(n, fpn);
+         continue;
+      }
+
+      /* No shared copy yet, look for a twin seen earlier in this pass */
+      for (u = ksm.unstable_head[h]; u >= 0; u = ksm.unstable_next[u])
+         if (ksm.cksum[u] == ck && MEMPHY_get_rmap(ksm.mram, u, NULL) != NULL &&
+             ksm_same(u, fpn))
+            break;
+
+      if (u < 0)
+      {
+         ksm.unstable_next[fpn] = ksm.unstable_head[h];
+         ksm.unstable_head[h] = fpn;
+         continue;
+      }
+
+      n = calloc(1, sizeof(struct ksm_node));
+      if (n == NULL)
+         continue;
+      n->fpn = u;
+      n->cksum = ck;
+      if (ksm_add_map(n, u) != 0)
+      {
+         free(n);
+         continue;
+      }
+      n->next = ksm.htab[h];
+      ksm.htab[h] = n;
+      ksm.node[u] = n;
+      ksm.nr_shared++;
+
+      ksm_add_map(n, fpn);
+   }
+
+   ksm.nr_pass++;
+   if (ksm.nr_sharing - ksm.nr_shared > ksm.max_saved)
+      ksm.max_saved = ksm.nr_sharing - ksm.nr_shared;
+
+   return ksm.nr_merge - merged;
+}
+
+/*
+ *  ksm_share - map one more page on a frame, copy on write
+ *  @mm: address space of the new mapping
+ *  @pgn: page number of the new mapping
+ *  @fpn: private or shared frame
+ *
+ *  A private frame becomes shared with its owner first, the owner PTE is
+ *  marked copy on write. The PTE of the new mapping is left to the caller.
+ */
+int ksm_share(struct mm_struct *mm, addr_t pgn, addr_t fpn)
+{
+   BYTE page[KSM_PAGESZ];
+   struct ksm_rmap_item *it;
+   struct ksm_node *n;
+   int h;
+
+   if (ksm.mram == NULL || fpn >= ksm.mram->fpnum)
+      return -1;
+
+   n = ksm.node[fpn];
+   if (n == NULL)
+   {
+      /* Hashed by content like a merged frame, so a scan can merge into it */
+      if (MEMPHY_read_block(ksm.mram, fpn * KSM_PAGESZ, page, KSM_PAGESZ) != 0)
+         return -1;
+
+      n = calloc(1, sizeof(struct ksm_node));
+      if (n == NULL)
+         return -1;
+      n->fpn = fpn;
+      n->cksum = ksm_checksum(page);
+      if (ksm_add_map(n, fpn) != 0)
+      {
+         free(n);
+         return -1;
+      }
+      h = n->cksum % KSM_HSIZE;
+      n->next = ksm.htab[h];
+      ksm.htab[h] = n;
+      ksm.node[fpn] = n;
+      ksm.nr_shared++;
+   }
+
+   it = malloc(sizeof(struct ksm_rmap_item));
+   if (it == NULL)
+      return -1;
+
+   it->mm = mm;
+   it->pgn = pgn;
+   it->next = n->maps;
+   n->maps = it;
+   n->nr_map++;
+   ksm.nr_sharing++;
+
+   return 0;
+}
+
+/*
+ *  ksm_unmap - drop the mapping of a page on a shared frame
+ *  @mm: owner of the page
+ *  @pgn: page number
+ *  @fpn: shared frame
+ *
+ *  The PTE itself is left to the caller. Return 0 when the page was the
+ *  last one, the frame then belongs to the caller, 1 while other pages
+ *  still map it, -1 when the frame is not shared.
+ */
+int ksm_unmap(struct mm_struct *mm, addr_t pgn, addr_t fpn)
+{
+   struct ksm_node *n, **pn;
+   struct ksm_rmap_item *it, **pit;
+
+   if (ksm.mram == NULL || fpn >= ksm.mram->fpnum || ksm.node[fpn] == NULL)
+      return -1;
+
+   n = ksm.node[fpn];
+   for (pit = &n->maps; *pit != NULL; pit = &(*pit)->next)
+      if ((*pit)->mm == mm && (*pit)->pgn == pgn)
+         break;
+   if (*pit == NULL)
+      return -1;
+
+   it = *pit;
+   *pit = it->next;
+   free(it);
+   n->nr_map--;
+   ksm.nr_sharing--;
+   ksm.nr_unshare++;
+
+   if (n->nr_map > 0)
+      return 1;
+
+   for (pn = &ksm.htab[n->cksum % KSM_HSIZE]; *pn != n; pn = &(*pn)->next)
+      ;
+   *pn = n->next;
+   ksm.node[fpn] = NULL;
+   ksm.nr_shared--;
+   free(n);
+
+   /* Forget the checksum, the frame may be reused for anything */
+   ksm.cksum[fpn] = 0;
+   return 0;
+}
+
+/*
+ *  ksm_swap_out - move the pages left on a shared frame to a swap slot
+ *  @fpn: shared frame, its content already in the slot
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ *
+ *  Every page takes its own reference on the slot, the frame is no longer
+ *  shared afterwards and belongs to the caller.
+ */
+int ksm_swap_out(addr_t fpn, int swptyp, addr_t swpfpn)
+{
+   struct ksm_rmap_item *it;
+   struct mm_struct *mm;
+   addr_t pgn, pte_addr;
+   uint64_t pte;
+   int nr = 0;
+
+   if (ksm.mram == NULL || fpn >= ksm.mram->fpnum || ksm.node[fpn] == NULL)
+      return -1;
+
+   while (ksm.node[fpn] != NULL)
+   {
+      it = ksm.node[fpn]->maps;
+      mm = it->mm;
+      pgn = it->pgn;
+
+      if (get_pte_address(mm, ksm.mram, pgn, &pte_addr) == 0 &&
+          MEMPHY_read64(ksm.mram, pte_addr, &pte) == 0 &&
+          PAGING_PAGE_PRESENT(pte) && !PAGING_PAGE_SWAPPED(pte) && PAGING_FPN(pte) == fpn &&
+          swap_dup_slot(swptyp, swpfpn) == 0)
+      {
+         SETBIT(pte, PAGING_PTE_SWAPPED_MASK);
+         CLRBIT(pte, PAGING_PTE_COW_MASK);
+         SETVAL(pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+         SETVAL(pte, swpfpn, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+         MEMPHY_write64(ksm.mram, pte_addr, pte);
+         tlb_flush_page(mm, pgn);
+         nr++;
+      }
+
+      ksm_unmap(mm, pgn, fpn);
+   }
+
+   return nr;
+}
+
+/*
+ *  ksm_mapcount - number of pages on a shared frame, 0 if private
+ *  @fpn: frame
+ */
+int ksm_mapcount(addr_t fpn)
+{
+   if (ksm.mram == NULL || fpn >= ksm.mram->fpnum || ksm.node[fpn] == NULL)
+      return 0;
+
+   return ksm.node[fpn]->nr_map;
+}
+
+/*
+ *  ksm_report - print what merging saved, quiet when nothing merged
+ */
+void ksm_report(void)
+{
+   if (ksm.nr_merge == 0)
+      return;
+
+   printf("KSM: %lu passes, %lu pages merged, %lu unshared, %lu shared frames "
+          "for %lu pages now, %lu bytes saved now, %lu at peak\n",
+          (unsigned long)ksm.nr_pass, (unsigned long)ksm.nr_merge,
+          (unsigned long)ksm.nr_unshare, (unsigned long)ksm.nr_shared,
+          (unsigned long)ksm.nr_sharing,
+          (unsigned long)((ksm.nr_sharing - ksm.nr_shared) * KSM_PAGESZ),
+          (unsigned long)(ksm.max_saved * KSM_PAGESZ));
+}
+
+/*
+ *  ksm_exit - drop the merging state, shared frames stay mapped
+ */
+void ksm_exit(void)
+{
+   struct ksm_node *n;
+   struct ksm_rmap_item *it;
+   int i;
+
+   for (i = 0; i < KSM_HSIZE; i++)
+      while ((n = ksm.htab[i]) != NULL)
+      {
+         ksm.htab[i] = n->next;
+         while ((it = n->maps) != NULL)
+         {
+            n->maps = it->next;
+            free(it);
+         }
+         free(n);
+      }
+
+   free(ksm.cksum);
+   free(ksm.node);
+   free(ksm.unstable_head);
+   free(ksm.unstable_next);
+   ksm.cksum = NULL;
+   ksm.node = NULL;
+   ksm.unstable_head = NULL;
+   ksm.unstable_next = NULL;
+   ksm.mram = NULL;
+}
+
+// #endif
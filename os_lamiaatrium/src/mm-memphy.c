@@ -14,31 +14,63 @@
  * Memory physical module mm/mm-memphy.c
  */
 
+#ifdef MM64
+#include "mm64.h"
+#else
 #include "mm.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef MM64
+#define MEMPHY_PAGESZ PAGING64_PAGESZ
+#else
+#define MEMPHY_PAGESZ PAGING_PAGESZ
+#endif
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
  *  @mp: memphy struct
  *  @offset: offset
+ *
+ *  The head travels straight to @offset; the distance it covers is
+ *  charged to seek_dist instead of being stepped through on the host.
  */
 int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
 {
-   int numstep = 0;
+   if (offset >= mp->maxsz)
+      return -1;
 
-   mp->cursor = 0;
-   while (numstep < offset && numstep < mp->maxsz)
+   if (offset != mp->cursor)
    {
-      /* Traverse sequentially */
-      mp->cursor = (mp->cursor + 1) % mp->maxsz;
-      numstep++;
+      mp->seek_dist += (offset > mp->cursor) ? offset - mp->cursor
+                                             : mp->cursor - offset;
+      mp->nr_seek++;
    }
+   mp->cursor = offset;
 
    return 0;
 }
 
+/*
+ *  MEMPHY_get_seekdist - total distance travelled by the cursor
+ *  @mp: memphy struct
+ *  @nr_seek: number of head moves, may be NULL
+ */
+uint64_t MEMPHY_get_seekdist(struct memphy_struct *mp, uint64_t *nr_seek)
+{
+   if (nr_seek != NULL)
+      *nr_seek = mp->nr_seek;
+
+   return mp->seek_dist;
+}
+
 /*
  *  MEMPHY_seq_read - read MEMPHY device
  *  @mp: memphy struct
@@ -50,11 +82,13 @@ int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
+   if (mp->rdmflg)
       return -1; /* Not compatible mode for sequential read */
 
-   MEMPHY_mv_csr(mp, addr);
+   if (MEMPHY_mv_csr(mp, addr) != 0)
+      return -1;
    *value = (BYTE)mp->storage[addr];
+   mp->cursor = addr + 1; /* the head streams past the byte */
 
    return 0;
 }
@@ -90,11 +124,13 @@ int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
-      return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+      return -1; /* Not compatible mode for sequential write */
 
-   MEMPHY_mv_csr(mp, addr);
+   if (MEMPHY_mv_csr(mp, addr) != 0)
+      return -1;
    mp->storage[addr] = value;
+   mp->cursor = addr + 1; /* the head streams past the byte */
 
    return 0;
 }
@@ -118,92 +154,1194 @@ int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_read_block - read len bytes of MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: start address
+ *  @buf: destination buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_read_block(struct memphy_struct *mp, addr_t addr, BYTE *buf, addr_t len)
+{
+   if (mp == NULL || addr + len > mp->maxsz)
+      return -1;
+
+   /* Sequential device pays one seek, then streams the block */
+   if (!mp->rdmflg && len > 0)
+   {
+      MEMPHY_mv_csr(mp, addr);
+      mp->cursor = addr + len;
+   }
+
+   memcpy(buf, mp->storage + addr, len);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_block - write len bytes to MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: start address
+ *  @buf: source buffer
+ *  @len: number of bytes
+ */
+int MEMPHY_write_block(struct memphy_struct *mp, addr_t addr, const BYTE *buf, addr_t len)
+{
+   if (mp == NULL || addr + len > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg && len > 0)
+   {
+      MEMPHY_mv_csr(mp, addr);
+      mp->cursor = addr + len;
+   }
+
+   memcpy(mp->storage + addr, buf, len);
+
+   return 0;
+}
+
+/*
+ * Words are kept little endian on the device, as the byte-wise PTE
+ * layout always was, whatever the host order is.
+ */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MEMPHY_LE32(v) __builtin_bswap32(v)
+#define MEMPHY_LE64(v) __builtin_bswap64(v)
+#else
+#define MEMPHY_LE32(v) (v)
+#define MEMPHY_LE64(v) (v)
+#endif
+
+int MEMPHY_read32(struct memphy_struct *mp, addr_t addr, uint32_t *value)
+{
+   uint32_t word;
+
+   if (MEMPHY_read_block(mp, addr, (BYTE *)&word, sizeof(word)) != 0)
+      return -1;
+
+   *value = MEMPHY_LE32(word);
+   return 0;
+}
+
+int MEMPHY_write32(struct memphy_struct *mp, addr_t addr, uint32_t value)
+{
+   uint32_t word = MEMPHY_LE32(value);
+
+   return MEMPHY_write_block(mp, addr, (BYTE *)&word, sizeof(word));
+}
+
+int MEMPHY_read64(struct memphy_struct *mp, addr_t addr, uint64_t *value)
+{
+   uint64_t word;
+
+   if (MEMPHY_read_block(mp, addr, (BYTE *)&word, sizeof(word)) != 0)
+      return -1;
+
+   *value = MEMPHY_LE64(word);
+   return 0;
+}
+
+int MEMPHY_write64(struct memphy_struct *mp, addr_t addr, uint64_t value)
+{
+   uint64_t word = MEMPHY_LE64(value);
+
+   return MEMPHY_write_block(mp, addr, (BYTE *)&word, sizeof(word));
+}
+
+/*
+ *  MEMPHY_read64_array - read nr consecutive words, a run of PTEs
+ *  @mp: memphy struct
+ *  @addr: address of the first word
+ *  @values: returned words
+ *  @nr: number of words
+ */
+int MEMPHY_read64_array(struct memphy_struct *mp, addr_t addr, uint64_t *values, int nr)
+{
+   int iter;
+
+   if (MEMPHY_read_block(mp, addr, (BYTE *)values, nr * sizeof(uint64_t)) != 0)
+      return -1;
+
+   for (iter = 0; iter < nr; iter++)
+      values[iter] = MEMPHY_LE64(values[iter]);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write64_array - write nr consecutive words
+ *  @mp: memphy struct
+ *  @addr: address of the first word
+ *  @values: words to write
+ *  @nr: number of words
+ */
+int MEMPHY_write64_array(struct memphy_struct *mp, addr_t addr, const uint64_t *values, int nr)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   int iter;
+
+   for (iter = 0; iter < nr; iter++)
+      if (MEMPHY_write64(mp, addr + iter * sizeof(uint64_t), values[iter]) != 0)
+         return -1;
+
+   return 0;
+#else
+   return MEMPHY_write_block(mp, addr, (const BYTE *)values, nr * sizeof(uint64_t));
+#endif
+}
+
+/*
+ * Frame bitmap helpers, frame fpn lives at bit (fpn % 64) of word (fpn / 64)
+ */
+#define FP_WORD_BITS 64
+#define FP_WORD(nr)  ((nr) / FP_WORD_BITS)
+#define FP_BIT(nr)   (1ULL << ((nr) % FP_WORD_BITS))
+#define FP_FULL      (~0ULL)
+
+static void memphy_mark_used(struct memphy_struct *mp, int fpn)
+{
+   int w = FP_WORD(fpn);
+
+   mp->fp_bitmap[w] |= FP_BIT(fpn);
+   if (mp->fp_bitmap[w] == FP_FULL)
+      mp->fp_summary[FP_WORD(w)] |= FP_BIT(w);
+}
+
+static void memphy_mark_free(struct memphy_struct *mp, int fpn)
+{
+   int w = FP_WORD(fpn);
+
+   mp->fp_bitmap[w] &= ~FP_BIT(fpn);
+   mp->fp_summary[FP_WORD(w)] &= ~FP_BIT(w);
+}
+
+static int memphy_is_used(struct memphy_struct *mp, int fpn)
+{
+   return (mp->fp_bitmap[FP_WORD(fpn)] & FP_BIT(fpn)) != 0;
+}
+
+/*
+ * Magazines of different CPUs share fp_cached words under their own
+ * locks, so the cached bits change atomically. Zero pool frames are
+ * cached too.
+ */
+static int memphy_test_set_cached(struct memphy_struct *mp, addr_t fpn)
+{
+   return (__atomic_fetch_or(&mp->fp_cached[FP_WORD(fpn)], FP_BIT(fpn), __ATOMIC_RELAXED) & FP_BIT(fpn)) != 0;
+}
+
+static void memphy_clear_cached(struct memphy_struct *mp, addr_t fpn)
+{
+   __atomic_fetch_and(&mp->fp_cached[FP_WORD(fpn)], ~FP_BIT(fpn), __ATOMIC_RELAXED);
+}
+
+static int memphy_is_cached(struct memphy_struct *mp, addr_t fpn)
+{
+   return (__atomic_load_n(&mp->fp_cached[FP_WORD(fpn)], __ATOMIC_RELAXED) & FP_BIT(fpn)) != 0;
+}
+
+/*
+ * A frame is dirty once handed out, the storage is mapped zero filled so
+ * the others still read as zeros. Handouts run under magazine locks too.
+ */
+static int memphy_test_set_dirty(struct memphy_struct *mp, addr_t fpn)
+{
+   return (__atomic_fetch_or(&mp->fp_dirty[FP_WORD(fpn)], FP_BIT(fpn), __ATOMIC_RELAXED) & FP_BIT(fpn)) != 0;
+}
+
+static int memphy_test_clear_dirty(struct memphy_struct *mp, addr_t fpn)
+{
+   return (__atomic_fetch_and(&mp->fp_dirty[FP_WORD(fpn)], ~FP_BIT(fpn), __ATOMIC_RELAXED) & FP_BIT(fpn)) != 0;
+}
+
+/*
+ *  memphy_find_free - find a free frame, starting from the last hint
+ *  @mp: memphy struct
+ *
+ *  The summary bitmap skips 64 full words (4096 frames) per probe, so
+ *  this costs a handful of word operations even on large devices.
+ */
+static int memphy_find_free(struct memphy_struct *mp)
+{
+   int nwords = DIV_ROUND_UP(mp->fpnum, FP_WORD_BITS);
+   int nsum = DIV_ROUND_UP(nwords, FP_WORD_BITS);
+   int it, s, w;
+   uint64_t avail;
+
+   for (it = 0; it < nsum; it++)
+   {
+      s = (FP_WORD(mp->fp_hint) + it) % nsum;
+      avail = ~mp->fp_summary[s];
+      if (avail == 0)
+         continue;
+
+      w = s * FP_WORD_BITS + __builtin_ctzll(avail);
+      mp->fp_hint = w;
+      return w * FP_WORD_BITS + __builtin_ctzll(~mp->fp_bitmap[w]);
+   }
+
+   return -1;
+}
+
+/*
+ *  memphy_word_run - first run of num free frames inside one word
+ *  @word: bitmap word, set bits are used frames
+ *  @num: run length, below FP_WORD_BITS
+ *
+ *  Each step ANDs the free mask with itself shifted, doubling the run
+ *  length a set bit stands for, so this takes log2(num) word operations.
+ *  Return the bit the run starts at, or -1.
+ */
+static int memphy_word_run(uint64_t word, int num)
+{
+   uint64_t m = ~word;
+   int len = 1, sh;
+
+   while (len < num && m != 0)
+   {
+      sh = (num - len < len) ? num - len : len;
+      m &= m >> sh;
+      len += sh;
+   }
+
+   return (m != 0) ? __builtin_ctzll(m) : -1;
+}
+
+/*
+ *  memphy_find_free_range - first fit search of num contiguous free frames
+ *  @mp: memphy struct
+ *  @num: number of frames
+ *
+ *  The bitmap is read a word at a time: free words extend the run by 64
+ *  frames, a partly used word ends it with its free low bits and starts
+ *  a new one with its free high bits. The summary skips 64 full words
+ *  per probe, so the cost is one step per word that still has a free
+ *  frame before the run is found.
+ */
+static int memphy_find_free_range(struct memphy_struct *mp, int num)
+{
+   int nwords = DIV_ROUND_UP(mp->fpnum, FP_WORD_BITS);
+   int w = 0, start = 0, run = 0, bit;
+   uint64_t word;
+
+   while (w < nwords)
+   {
+      /* 64 full words at once */
+      if (w % FP_WORD_BITS == 0 && mp->fp_summary[FP_WORD(w)] == FP_FULL)
+      {
+         run = 0;
+         w += FP_WORD_BITS;
+         continue;
+      }
+
+      word = mp->fp_bitmap[w];
+      if (word == 0)
+      {
+         if (run == 0)
+            start = w * FP_WORD_BITS;
+         run += FP_WORD_BITS;
+      }
+      else
+      {
+         /* Free low bits close the run coming from the previous word */
+         if (run > 0 && run + __builtin_ctzll(word) >= num)
+            return start;
+
+         if (num < FP_WORD_BITS && (bit = memphy_word_run(word, num)) >= 0)
+            return w * FP_WORD_BITS + bit;
+
+         /* Free high bits open the next one */
+         run = __builtin_clzll(word);
+         start = (w + 1) * FP_WORD_BITS - run;
+      }
+
+      if (run >= num)
+         return start;
+      w++;
+   }
+
+   return -1;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *  @pagesz: frame size
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
    int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
+   int nwords, nsum, iter;
+
+   mp->fpnum = mp->free_fpnum = 0;
+   mp->fp_hint = 0;
+   mp->fp_bitmap = mp->fp_summary = mp->fp_cached = mp->fp_dirty = NULL;
+   mp->rmap = NULL;
+   mp->zero_nr = mp->zero_max = 0;
+   pthread_mutex_init(&mp->fp_lock, NULL);
+
+   for (iter = 0; iter < MEMPHY_MAX_CPUS; iter++)
+   {
+      mp->mags[iter].nr = 0;
+      pthread_mutex_init(&mp->mags[iter].lock, NULL);
+   }
 
    if (numfp <= 0)
       return -1;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
+   nwords = DIV_ROUND_UP(numfp, FP_WORD_BITS);
+   nsum = DIV_ROUND_UP(nwords, FP_WORD_BITS);
+   mp->fp_bitmap = calloc(nwords, sizeof(uint64_t));
+   mp->fp_summary = calloc(nsum, sizeof(uint64_t));
+   mp->fp_cached = calloc(nwords, sizeof(uint64_t));
+   mp->fp_dirty = calloc(nwords, sizeof(uint64_t));
+   mp->rmap = calloc(numfp, sizeof(struct memphy_rmap_struct));
+   if (mp->fp_bitmap == NULL || mp->fp_summary == NULL || mp->fp_cached == NULL ||
+       mp->fp_dirty == NULL || mp->rmap == NULL)
+      return -1;
+
+   mp->fpnum = numfp;
+   mp->free_fpnum = numfp;
+   mp->zero_max = (numfp / 8 < MEMPHY_ZERO_POOL) ? numfp / 8 : MEMPHY_ZERO_POOL;
+
+   /* Tail bits past the last frame are never handed out */
+   for (iter = numfp; iter < nwords * FP_WORD_BITS; iter++)
+      memphy_mark_used(mp, iter);
+   for (iter = nwords; iter < nsum * FP_WORD_BITS; iter++)
+      mp->fp_summary[FP_WORD(iter)] |= FP_BIT(iter);
+
+   /* Frame 0 stands for no frame, a PGD there would read as a NULL pgd */
+   memphy_mark_used(mp, 0);
+   mp->free_fpnum--;
+
+   return 0;
+}
+
+/*
+ *  memphy_get_batch - take up to num frames from the device bitmap
+ *  @mp: memphy struct
+ *  @fpns: returned frames
+ *  @num: wanted number of frames
+ */
+static int memphy_get_batch(struct memphy_struct *mp, addr_t *fpns, int num)
+{
+   int nr = 0, fpn;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   while (nr < num && mp->free_fpnum > 0 && (fpn = memphy_find_free(mp)) >= 0)
+   {
+      memphy_mark_used(mp, fpn);
+      mp->free_fpnum--;
+      fpns[nr++] = fpn;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return nr;
+}
+
+/*
+ *  memphy_put_batch - give num frames back to the device bitmap
+ *  @mp: memphy struct
+ *  @fpns: released frames
+ *  @num: number of frames
+ */
+static void memphy_put_batch(struct memphy_struct *mp, addr_t *fpns, int num)
+{
+   int iter;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (iter = 0; iter < num; iter++)
+   {
+      if (fpns[iter] >= mp->fpnum || !memphy_is_used(mp, fpns[iter]))
+         continue;
+
+      memphy_clear_cached(mp, fpns[iter]);
+      memphy_mark_free(mp, fpns[iter]);
+      mp->free_fpnum++;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+}
+
+/*
+ * Simulated CPU the calling thread runs, -1 for loader and other threads
+ */
+static __thread int memphy_cpuid = -1;
+
+void MEMPHY_set_cpu(int cpuid)
+{
+   memphy_cpuid = cpuid;
+}
+
+static struct memphy_mag_struct *memphy_get_mag(struct memphy_struct *mp)
+{
+   if (memphy_cpuid < 0 || memphy_cpuid >= MEMPHY_MAX_CPUS || mp->fpnum == 0)
+      return NULL;
+
+   return &mp->mags[memphy_cpuid];
+}
+
+/*
+ *  memphy_drain_mags - return every cached frame to the device bitmap
+ *  @mp: memphy struct
+ *
+ *  Only used when the bitmap runs dry, so frames parked in the
+ *  magazines of other CPUs never cause a false out of memory.
+ */
+static void memphy_drain_mags(struct memphy_struct *mp)
+{
+   struct memphy_mag_struct *mag;
+   int cpu;
+
+   for (cpu = 0; cpu < MEMPHY_MAX_CPUS; cpu++)
+   {
+      mag = &mp->mags[cpu];
+      pthread_mutex_lock(&mag->lock);
+      memphy_put_batch(mp, mag->fpn, mag->nr);
+      mag->nr = 0;
+      pthread_mutex_unlock(&mag->lock);
+   }
+}
+
+/*
+ *  memphy_get_freefp - take a free frame, magazine first
+ *  @mp: memphy struct
+ *  @retfpn: returned frame
+ */
+static int memphy_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
+{
+   struct memphy_mag_struct *mag;
+   int i;
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   for (iter = 1; iter < numfp; iter++)
+   mag = memphy_get_mag(mp);
+   if (mag != NULL)
    {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr == 0)
+      {
+         mag->nr = memphy_get_batch(mp, mag->fpn, MEMPHY_MAG_BATCH);
+         for (i = 0; i < mag->nr; i++)
+            memphy_test_set_cached(mp, mag->fpn[i]);
+      }
+
+      if (mag->nr > 0)
+      {
+         *retfpn = mag->fpn[--mag->nr];
+         memphy_clear_cached(mp, *retfpn);
+         pthread_mutex_unlock(&mag->lock);
+         return 0;
+      }
+      pthread_mutex_unlock(&mag->lock);
    }
 
+   if (memphy_get_batch(mp, retfpn, 1) == 1)
+      return 0;
+
+   /* Bitmap is empty, pull back what the other CPUs are holding */
+   memphy_drain_mags(mp);
+
+   if (memphy_get_batch(mp, retfpn, 1) == 1)
+      return 0;
+
+   /* Last resort, a cleared frame is a free frame too */
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->zero_nr == 0)
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
+      return -1;
+   }
+   *retfpn = mp->zero_fp[--mp->zero_nr];
+   memphy_clear_cached(mp, *retfpn);
+   pthread_mutex_unlock(&mp->fp_lock);
    return 0;
 }
 
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   if (mp == NULL || memphy_get_freefp(mp, retfpn) != 0)
+      return -1;
 
-   if (fp == NULL)
+   /* The new holder may write it */
+   memphy_test_set_dirty(mp, *retfpn);
+   return 0;
+}
+
+/*
+ *  MEMPHY_zero_refill - clear frames ahead of use
+ *  @mp: memphy struct
+ *  @reserve: free frames left in the bitmap
+ *
+ *  Called from background work, so page table and page allocation
+ *  find the pool full. Frames are taken and pooled under fp_lock but
+ *  cleared outside it, and only those handed out since the storage
+ *  was mapped need clearing at all. Frames being cleared can be had by
+ *  no one, so the last reserve free frames are never taken.
+ */
+int MEMPHY_zero_refill(struct memphy_struct *mp, int reserve)
+{
+   addr_t fpns[MEMPHY_ZERO_POOL];
+   int nr, i;
+
+   if (mp == NULL || mp->storage == NULL)
       return -1;
 
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   pthread_mutex_lock(&mp->fp_lock);
+   nr = mp->zero_max - mp->zero_nr;
+   if (nr > mp->free_fpnum - reserve)
+      nr = mp->free_fpnum - reserve;
+   pthread_mutex_unlock(&mp->fp_lock);
+   if (nr <= 0)
+      return 0;
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+   nr = memphy_get_batch(mp, fpns, nr);
+   for (i = 0; i < nr; i++)
+      if (memphy_test_clear_dirty(mp, fpns[i]))
+         memset(mp->storage + fpns[i] * MEMPHY_PAGESZ, 0, MEMPHY_PAGESZ);
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (i = 0; i < nr; i++)
+   {
+      if (mp->zero_nr < mp->zero_max)
+      {
+         memphy_test_set_cached(mp, fpns[i]);
+         mp->zero_fp[mp->zero_nr++] = fpns[i];
+      }
+      else
+      {
+         /* A racing refill filled the pool, still clean for later */
+         memphy_mark_free(mp, fpns[i]);
+         mp->free_fpnum++;
+      }
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+   return 0;
+}
+
+/*
+ *  MEMPHY_get_zerofp - get a free frame filled with zeros
+ *  @mp: memphy struct
+ *  @retfpn: returned frame
+ *
+ *  The pool is only refilled in the background. Without it, a frame
+ *  never handed out since the storage was mapped is still zero, and any
+ *  other one is cleared here, outside every allocator lock.
+ */
+int MEMPHY_get_zerofp(struct memphy_struct *mp, addr_t *retfpn)
+{
+   if (mp == NULL || mp->storage == NULL)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->zero_nr > 0)
+   {
+      *retfpn = mp->zero_fp[--mp->zero_nr];
+      memphy_clear_cached(mp, *retfpn);
+      pthread_mutex_unlock(&mp->fp_lock);
+      memphy_test_set_dirty(mp, *retfpn);
+      return 0;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   if (memphy_get_freefp(mp, retfpn) != 0)
+      return -1;
+
+   if (memphy_test_set_dirty(mp, *retfpn))
+      memset(mp->storage + *retfpn * MEMPHY_PAGESZ, 0, MEMPHY_PAGESZ);
+   return 0;
+}
+
+/*
+ *  MEMPHY_clear_frame - fill a frame with zeros
+ *  @mp: memphy struct
+ *  @fpn: frame
+ */
+int MEMPHY_clear_frame(struct memphy_struct *mp, addr_t fpn)
+{
+   if (mp == NULL || mp->storage == NULL || fpn >= mp->fpnum)
+      return -1;
+
+   memset(mp->storage + fpn * MEMPHY_PAGESZ, 0, MEMPHY_PAGESZ);
+   return 0;
+}
+
+/*
+ *  MEMPHY_nr_freefp - number of free frames, magazines included
+ *  @mp: memphy struct
+ *
+ *  The magazine counts are read without their locks, the result is a
+ *  snapshot good enough for watermarks and statistics.
+ */
+int MEMPHY_nr_freefp(struct memphy_struct *mp)
+{
+   int nr, cpu;
+
+   if (mp == NULL)
+      return 0;
+
+   nr = mp->free_fpnum + mp->zero_nr;
+   for (cpu = 0; cpu < MEMPHY_MAX_CPUS; cpu++)
+      nr += mp->mags[cpu].nr;
+
+   return nr;
+}
+
+/*
+ *  MEMPHY_get_freefp_range - get num physically contiguous free frames
+ *  @mp: memphy struct
+ *  @num: number of frames
+ *  @retfpn: first frame of the run
+ */
+static int memphy_get_freefp_range(struct memphy_struct *mp, int num, addr_t *retfpn)
+{
+   int fpn, iter;
+
+   if (num == 1)
+      return memphy_get_freefp(mp, retfpn);
+
+   pthread_mutex_lock(&mp->fp_lock);
+   if (mp->free_fpnum < num || (fpn = memphy_find_free_range(mp, num)) < 0)
+   {
+      pthread_mutex_unlock(&mp->fp_lock);
+
+      /* Cached or cleared frames may be exactly the ones that split the run */
+      memphy_drain_mags(mp);
+
+      pthread_mutex_lock(&mp->fp_lock);
+      while (mp->zero_nr > 0)
+      {
+         memphy_clear_cached(mp, mp->zero_fp[--mp->zero_nr]);
+         memphy_mark_free(mp, mp->zero_fp[mp->zero_nr]);
+         mp->free_fpnum++;
+      }
+      if (mp->free_fpnum < num || (fpn = memphy_find_free_range(mp, num)) < 0)
+      {
+         pthread_mutex_unlock(&mp->fp_lock);
+         return -1;
+      }
+   }
+
+   for (iter = 0; iter < num; iter++)
+      memphy_mark_used(mp, fpn + iter);
+   mp->free_fpnum -= num;
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   *retfpn = fpn;
+   return 0;
+}
+
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int num, addr_t *retfpn)
+{
+   int iter;
+
+   if (mp == NULL || num <= 0 || memphy_get_freefp_range(mp, num, retfpn) != 0)
+      return -1;
+
+   for (iter = 0; iter < num; iter++)
+      memphy_test_set_dirty(mp, *retfpn + iter);
+   return 0;
+}
+
+/*
+ *  MEMPHY_get_zerofp_range - get num contiguous frames filled with zeros
+ *  @mp: memphy struct
+ *  @num: number of frames
+ *  @retfpn: first frame of the run
+ *
+ *  Like MEMPHY_get_zerofp, only frames handed out before are cleared.
+ */
+int MEMPHY_get_zerofp_range(struct memphy_struct *mp, int num, addr_t *retfpn)
+{
+   int iter;
+
+   if (mp == NULL || mp->storage == NULL || num <= 0 ||
+       memphy_get_freefp_range(mp, num, retfpn) != 0)
+      return -1;
+
+   for (iter = 0; iter < num; iter++)
+      if (memphy_test_set_dirty(mp, *retfpn + iter))
+         memset(mp->storage + (*retfpn + iter) * MEMPHY_PAGESZ, 0, MEMPHY_PAGESZ);
+   return 0;
+}
+
+/*
+ * Dump sink, text is staged and handed to stdio in MEMPHY_DUMP_BUFSZ blocks
+ */
+#define MEMPHY_DUMP_BUFSZ 8192
+#define MEMPHY_DUMP_LINE 16   /* bytes per dump line */
+
+struct memphy_sink {
+   FILE *out;
+   int len;
+   char buf[MEMPHY_DUMP_BUFSZ];
+};
+
+static void memphy_sink_flush(struct memphy_sink *sk)
+{
+   if (sk->len > 0)
+      fwrite(sk->buf, 1, sk->len, sk->out);
+   sk->len = 0;
+}
+
+static void memphy_sink_printf(struct memphy_sink *sk, const char *fmt, ...)
+{
+   va_list ap;
+   int n;
+
+   va_start(ap, fmt);
+   n = vsnprintf(sk->buf + sk->len, MEMPHY_DUMP_BUFSZ - sk->len, fmt, ap);
+   va_end(ap);
+
+   if (n >= MEMPHY_DUMP_BUFSZ - sk->len)
+   {
+      memphy_sink_flush(sk);
+      va_start(ap, fmt);
+      n = vsnprintf(sk->buf, MEMPHY_DUMP_BUFSZ, fmt, ap);
+      va_end(ap);
+      if (n >= MEMPHY_DUMP_BUFSZ)
+         n = MEMPHY_DUMP_BUFSZ - 1;
+   }
+   sk->len += n;
+}
+
+/*
+ *  memphy_sink_hexline - one line of address and bytes, no printf per byte
+ */
+static void memphy_sink_hexline(struct memphy_sink *sk, addr_t addr, const BYTE *data)
+{
+   static const char hex[] = "0123456789abcdef";
+   char *p;
+   int i;
+
+   if (MEMPHY_DUMP_BUFSZ - sk->len < 32 + 3 * MEMPHY_DUMP_LINE)
+      memphy_sink_flush(sk);
+
+   p = sk->buf + sk->len;
+   p += sprintf(p, "  %08lx:", (unsigned long)addr);
+   for (i = 0; i < MEMPHY_DUMP_LINE; i++)
+   {
+      *p++ = ' ';
+      *p++ = hex[(uint8_t)data[i] >> 4];
+      *p++ = hex[(uint8_t)data[i] & 0xf];
+   }
+   *p++ = '\n';
+   sk->len = p - sk->buf;
+}
+
+/*
+ *  memphy_is_zero - whole words OR-ed together, the compiler vectorizes it
+ *  @data: 8 byte aligned block
+ *  @len: multiple of 64
+ */
+static int memphy_is_zero(const BYTE *data, addr_t len)
+{
+   const uint64_t *w = (const uint64_t *)data;
+   addr_t i, j;
+   uint64_t acc;
+
+   for (i = 0; i < len / 8; i += 8)
+   {
+      acc = 0;
+      for (j = 0; j < 8; j++)
+         acc |= w[i + j];
+      if (acc != 0)
+         return 0;
+   }
+
+   return 1;
+}
+
+static int memphy_is_zero_line(const BYTE *data)
+{
+   const uint64_t *w = (const uint64_t *)data;
+
+   return (w[0] | w[1]) == 0;
+}
+
+/*
+ *  memphy_dump_frame - print the non-zero lines of a frame within [start, end)
+ *  @pid: only a frame owned by this process, -1 for any frame
+ *
+ *  The owner comes from the rmap entry alone, its mm may be going away.
+ */
+static void memphy_dump_frame(struct memphy_struct *mp, struct memphy_sink *sk, addr_t fpn,
+                              addr_t start, addr_t end, int pid)
+{
+   struct memphy_rmap_struct *rm = &mp->rmap[fpn];
+   const BYTE *frame;
+   addr_t off;
+
+   if (pid >= 0 && (rm->mm == NULL || (int)rm->pid != pid))
+      return;
+
+   frame = mp->storage + fpn * MEMPHY_PAGESZ;
+   if (memphy_is_zero(frame, MEMPHY_PAGESZ))
+      return;
+
+   if (rm->mm == NULL)
+      memphy_sink_printf(sk, "MEMPHY frame %lu: %s\n", (unsigned long)fpn,
+                         memphy_is_used(mp, fpn) ? "no owner" : "free");
+   else if (rm->pgn == MEMPHY_RMAP_PGTBL)
+      memphy_sink_printf(sk, "MEMPHY frame %lu: pid %u page table\n",
+                         (unsigned long)fpn, rm->pid);
+   else
+      memphy_sink_printf(sk, "MEMPHY frame %lu: pid %u page %lu\n",
+                         (unsigned long)fpn, rm->pid, (unsigned long)rm->pgn);
+
+   for (off = 0; off < MEMPHY_PAGESZ; off += MEMPHY_DUMP_LINE)
+   {
+      if (fpn * MEMPHY_PAGESZ + off < start || fpn * MEMPHY_PAGESZ + off >= end)
+         continue;
+      if (memphy_is_zero_line(frame + off))
+         continue;
+      memphy_sink_hexline(sk, fpn * MEMPHY_PAGESZ + off, frame + off);
+   }
+}
+
+/*
+ *  MEMPHY_dump_range - print the non-zero content of a device
+ *  @mp: memphy struct
+ *  @start: first address
+ *  @end: address past the last one, clamped to the device size
+ *  @pid: only frames owned by this process, -1 for any frame
+ *  @out: stream to write to
+ *
+ *  Zero frames and zero lines inside a frame are skipped. Every frame of
+ *  the range is looked at, a process dump goes through MEMPHY_dump_frames.
+ */
+int MEMPHY_dump_range(struct memphy_struct *mp, addr_t start, addr_t end, int pid, FILE *out)
+{
+   struct memphy_sink sink, *sk = &sink;
+   addr_t fpn, lastfpn;
+
+   if (mp == NULL || mp->storage == NULL || mp->fpnum == 0)
+      return -1;
+
+   if (end > mp->maxsz)
+      end = mp->maxsz;
+   if (start >= end)
+      return 0;
+
+   sk->out = out;
+   sk->len = 0;
+   flockfile(out);
+
+   lastfpn = (end - 1) / MEMPHY_PAGESZ;
+   if (lastfpn >= mp->fpnum)
+      lastfpn = mp->fpnum - 1;
+
+   for (fpn = start / MEMPHY_PAGESZ; fpn <= lastfpn; fpn++)
+      memphy_dump_frame(mp, sk, fpn, start, end, pid);
+
+   memphy_sink_flush(sk);
+   funlockfile(out);
+
+   return 0;
+}
+
+static int memphy_cmp_fpn(const void *a, const void *b)
+{
+   addr_t x = *(const addr_t *)a, y = *(const addr_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+/*
+ *  MEMPHY_dump_frames - print the non-zero content of a set of frames
+ *  @mp: memphy struct
+ *  @fpns: frames, sorted here, duplicates printed once
+ *  @nr: number of frames
+ *  @pid: only frames owned by this process, -1 for any frame
+ *  @out: stream to write to
+ *
+ *  Frames come out in device order like MEMPHY_dump_range, but the cost
+ *  follows the frames listed rather than the device size.
+ */
+int MEMPHY_dump_frames(struct memphy_struct *mp, addr_t *fpns, int nr, int pid, FILE *out)
+{
+   struct memphy_sink sink, *sk = &sink;
+   int i;
+
+   if (mp == NULL || mp->storage == NULL)
+      return -1;
+
+   qsort(fpns, nr, sizeof(addr_t), memphy_cmp_fpn);
+
+   sk->out = out;
+   sk->len = 0;
+   flockfile(out);
+
+   for (i = 0; i < nr; i++)
+   {
+      if (fpns[i] >= mp->fpnum || (i > 0 && fpns[i] == fpns[i - 1]))
+         continue;
+      memphy_dump_frame(mp, sk, fpns[i], 0, mp->maxsz, pid);
+   }
+
+   memphy_sink_flush(sk);
+   funlockfile(out);
 
    return 0;
 }
 
 int MEMPHY_dump(struct memphy_struct *mp)
 {
-  /*TODO dump memphy contnt mp->storage
-   *     for tracing the memory content
-   */
+   if (mp == NULL)
+      return -1;
+
+   return MEMPHY_dump_range(mp, 0, mp->maxsz, -1, stdout);
+}
+
+/*
+ *  MEMPHY_set_rmap - record the owner of a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @mm: owning mm, NULL to clear
+ *  @pgn: page mapping the frame, MEMPHY_RMAP_PGTBL for a page table
+ *
+ *  Only the current holder of a frame writes its entry, so no lock.
+ */
+int MEMPHY_set_rmap(struct memphy_struct *mp, addr_t fpn, struct mm_struct *mm, addr_t pgn)
+{
+   if (mp == NULL || mp->rmap == NULL || fpn >= mp->fpnum)
+      return -1;
+
+   mp->rmap[fpn].mm = mm;
+   mp->rmap[fpn].pgn = pgn;
+   mp->rmap[fpn].pid = (mm != NULL) ? mm->pid : 0;
    return 0;
 }
 
+/*
+ *  MEMPHY_get_rmap - owner of a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @pgn: returned page mapping the frame, may be NULL
+ */
+struct mm_struct *MEMPHY_get_rmap(struct memphy_struct *mp, addr_t fpn, addr_t *pgn)
+{
+   if (mp == NULL || mp->rmap == NULL || fpn >= mp->fpnum)
+      return NULL;
+
+   if (pgn != NULL)
+      *pgn = mp->rmap[fpn].pgn;
+   return mp->rmap[fpn].mm;
+}
+
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   struct memphy_mag_struct *mag;
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   /* A frame parked in a magazine is still used in the bitmap, its
+    * cached bit tells a second release apart
+    */
+   if (mp == NULL || fpn >= mp->fpnum || !memphy_is_used(mp, fpn) ||
+       memphy_is_cached(mp, fpn))
+      return -1;
+
+   mag = memphy_get_mag(mp);
+   if (mag == NULL)
+   {
+      mp->rmap[fpn].mm = NULL;
+      return MEMPHY_put_freefp_range(mp, fpn, 1);
+   }
+
+   if (memphy_test_set_cached(mp, fpn))
+      return -1; /* a racing release of the same frame won */
+   mp->rmap[fpn].mm = NULL;
+
+   pthread_mutex_lock(&mag->lock);
+   if (mag->nr == MEMPHY_MAG_SZ)
+   {
+      /* Magazine full, hand its oldest batch back to the device */
+      memphy_put_batch(mp, mag->fpn, MEMPHY_MAG_BATCH);
+      memmove(mag->fpn, mag->fpn + MEMPHY_MAG_BATCH,
+              (MEMPHY_MAG_SZ - MEMPHY_MAG_BATCH) * sizeof(addr_t));
+      mag->nr -= MEMPHY_MAG_BATCH;
+   }
+   mag->fpn[mag->nr++] = fpn;
+   pthread_mutex_unlock(&mag->lock);
 
    return 0;
 }
 
+/*
+ *  MEMPHY_put_freefp_range - release num contiguous frames
+ *  @mp: memphy struct
+ *  @fpn: first frame of the run
+ *  @num: number of frames
+ */
+int MEMPHY_put_freefp_range(struct memphy_struct *mp, addr_t fpn, int num)
+{
+   int iter;
+
+   if (mp == NULL || num <= 0 || fpn + num > mp->fpnum)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (iter = 0; iter < num; iter++)
+   {
+      /* Releasing a free frame twice is a caller bug, keep the count sane */
+      if (!memphy_is_used(mp, fpn + iter) || memphy_is_cached(mp, fpn + iter))
+         continue;
+
+      memphy_mark_free(mp, fpn + iter);
+      mp->rmap[fpn + iter].mm = NULL;
+      mp->free_fpnum++;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return 0;
+}
+
+/*
+ *  memphy_alloc_storage - get zero filled backing storage
+ *  @size: storage size
+ *
+ *  Anonymous mappings are zero until first write, so frames the
+ *  workload never touches cost neither startup time nor host RSS.
+ */
+static BYTE *memphy_alloc_storage(addr_t size, int *mmapflg)
+{
+   BYTE *storage;
+
+   *mmapflg = 0;
+   if (size == 0)
+      return NULL;
+
+#ifdef MEMPHY_MMAP
+   storage = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (storage != MAP_FAILED)
+   {
+#ifdef MEMPHY_THP
+      madvise(storage, size, MADV_HUGEPAGE);
+#endif
+      *mmapflg = 1;
+      return storage;
+   }
+#endif
+
+   /* Heap fallback, still zero filled */
+   storage = (BYTE *)calloc(size, sizeof(BYTE));
+
+   return storage;
+}
+
 /*
  *  Init MEMPHY struct
  */
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
-   mp->maxsz = max_size;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
+   mp->fd = -1;
+   mp->ioq = NULL;
+   mp->storage = memphy_alloc_storage(max_size, &mp->mmapflg);
+   mp->maxsz = (mp->storage != NULL) ? max_size : 0;
 
+#ifdef MM64
+   MEMPHY_format(mp, PAGING64_PAGESZ);
+#else
    MEMPHY_format(mp, PAGING_PAGESZ);
+#endif
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
 
-   if (!mp->rdmflg) /* Not Ramdom acess device, then it serial device*/
-      mp->cursor = 0;
+   /* Not Ramdom acess device, then it serial device*/
+   mp->cursor = 0;
+   mp->seek_dist = 0;
+   mp->nr_seek = 0;
+
+   return 0;
+}
+
+/*
+ *  init_memphy_file - init MEMPHY struct on a sparse file
+ *  @mp: memphy struct
+ *  @max_size: device size
+ *  @randomflg: random access device
+ *  @path: backing file, created or truncated
+ *
+ *  The file is mapped shared so the device may be larger than host RAM
+ *  and its content stays on disk after the run. Falls back to host
+ *  memory when the file cannot be set up.
+ */
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path)
+{
+   BYTE *storage;
+   int fd;
+
+   if (max_size == 0)
+      return init_memphy(mp, max_size, randomflg);
+
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0 || ftruncate(fd, max_size) != 0)
+   {
+      printf("init_memphy_file: cannot use %s, fall back to memory\n", path);
+      if (fd >= 0)
+         close(fd);
+      return init_memphy(mp, max_size, randomflg);
+   }
+
+   storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (storage == MAP_FAILED)
+   {
+      printf("init_memphy_file: cannot map %s, fall back to memory\n", path);
+      close(fd);
+      return init_memphy(mp, max_size, randomflg);
+   }
+
+   init_memphy(mp, 0, randomflg);
+   mp->storage = storage;
+   mp->maxsz = max_size;
+   mp->mmapflg = 1;
+   mp->fd = fd;
+
+#ifdef MM64
+   MEMPHY_format(mp, PAGING64_PAGESZ);
+#else
+   MEMPHY_format(mp, PAGING_PAGESZ);
+#endif
+
+   return 0;
+}
+
+/*
+ *  free_memphy - release MEMPHY storage and management structure
+ *  @mp: memphy struct
+ */
+int free_memphy(struct memphy_struct *mp)
+{
+   if (mp->storage != NULL)
+   {
+      if (mp->mmapflg)
+         munmap(mp->storage, mp->maxsz);
+      else
+         free(mp->storage);
+   }
+
+   if (mp->fd >= 0)
+      close(mp->fd);
+
+   free(mp->fp_bitmap);
+   free(mp->fp_summary);
+   free(mp->fp_cached);
+   free(mp->fp_dirty);
+   free(mp->rmap);
+   mp->rmap = NULL;
+
+   if (mp->ioq != NULL)
+   {
+      pthread_mutex_destroy(&mp->ioq->lock);
+      free(mp->ioq->buf);
+      free(mp->ioq);
+      mp->ioq = NULL;
+   }
+
+   mp->storage = NULL;
+   mp->maxsz = 0;
+   mp->fd = -1;
+   mp->fpnum = mp->free_fpnum = 0;
+   mp->fp_bitmap = mp->fp_summary = mp->fp_cached = mp->fp_dirty = NULL;
 
    return 0;
 }
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Swap devices and I/O scheduler mm/mm-swap.c
+ *
+ * Swap frames are handed out across every configured MEMSWP. Devices of
+ * the same priority are striped round robin, a lower priority device is
+ * only used once all higher ones are full.
+ *
+ * Page transfers to a sequential MEMSWP are queued per device and sent in
+ * elevator (SCAN) order. Requests on adjacent swap frames are dispatched as
+ * one run, so the head seeks once per run instead of once per page. Random
+ * access devices bypass the queue.
+ */
+
+#include "mm64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef MM64
+#define SWAP_PAGESZ PAGING64_PAGESZ
+#else
+#define SWAP_PAGESZ PAGING_PAGESZ
+#endif
+
+/* Swap areas switched on, indexed by swap type */
+static struct swap_info_struct {
+   struct memphy_struct *mp;
+   int prio;
+   uint64_t nr_swpout;
+   uint64_t nr_swpin;
+   int *swap_map;    /* per frame extra mappers left by fork, NULL until one */
+} swap_info[PAGING_MAX_MMSWP];
+
+static int swap_rr;  /* next swap type to try within a priority */
+static pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  swap_on - make a device available for swapping
+ *  @mp: swap device
+ *  @swptyp: swap type, the device index stored in swapped PTEs
+ *  @prio: higher priority devices fill first
+ */
+int swap_on(struct memphy_struct *mp, int swptyp, int prio)
+{
+   if (mp == NULL || mp->maxsz == 0 || swptyp < 0 || swptyp >= PAGING_MAX_MMSWP)
+      return -1;
+
+   if (swap_ioq_init(mp) != 0)
+      return -1;
+
+   pthread_mutex_lock(&swap_lock);
+   swap_info[swptyp].mp = mp;
+   swap_info[swptyp].prio = prio;
+   pthread_mutex_unlock(&swap_lock);
+
+   return 0;
+}
+
+/*
+ *  swap_get_dev - device of a swap type
+ *  @swptyp: swap type
+ */
+struct memphy_struct *swap_get_dev(int swptyp)
+{
+   if (swptyp < 0 || swptyp >= PAGING_MAX_MMSWP)
+      return NULL;
+
+   return swap_info[swptyp].mp;
+}
+
+/*
+ *  swap_get_slot - allocate a swap frame
+ *  @swptyp: return swap type
+ *  @swpfpn: return swap frame
+ *
+ *  Devices are tried priority by priority, round robin within one, and a
+ *  full device is skipped.
+ */
+int swap_get_slot(int *swptyp, addr_t *swpfpn)
+{
+   int tried[PAGING_MAX_MMSWP] = {0};
+   int i, id, prio, found;
+
+   pthread_mutex_lock(&swap_lock);
+   while (1)
+   {
+      /* Highest priority left to try */
+      found = 0;
+      prio = 0;
+      for (i = 0; i < PAGING_MAX_MMSWP; i++)
+         if (swap_info[i].mp != NULL && !tried[i] && (!found || swap_info[i].prio > prio))
+         {
+            prio = swap_info[i].prio;
+            found = 1;
+         }
+
+      if (!found)
+         break;
+
+      for (i = 0; i < PAGING_MAX_MMSWP; i++)
+      {
+         id = (swap_rr + i) % PAGING_MAX_MMSWP;
+         if (swap_info[id].mp == NULL || tried[id] || swap_info[id].prio != prio)
+            continue;
+
+         tried[id] = 1;
+         if (MEMPHY_get_freefp(swap_info[id].mp, swpfpn) == 0)
+         {
+            swap_rr = id + 1;
+            *swptyp = id;
+            pthread_mutex_unlock(&swap_lock);
+            return 0;
+         }
+      }
+   }
+   pthread_mutex_unlock(&swap_lock);
+
+   return -1; /* every swap device is full */
+}
+
+/*
+ *  swap_ioq_init - attach an I/O queue to a sequential device
+ *  @mp: swap device
+ */
+int swap_ioq_init(struct memphy_struct *mp)
+{
+   struct memphy_ioq_struct *ioq;
+   int i;
+
+   if (mp == NULL || mp->rdmflg || mp->maxsz == 0)
+      return 0;
+
+   ioq = calloc(1, sizeof(struct memphy_ioq_struct));
+   if (ioq == NULL)
+      return -1;
+
+   ioq->buf = malloc(MEMSWP_IOQ_DEPTH * SWAP_PAGESZ);
+   if (ioq->buf == NULL)
+   {
+      free(ioq);
+      return -1;
+   }
+
+   /* Each slot owns one staging page, slots are only ever swapped */
+   for (i = 0; i < MEMSWP_IOQ_DEPTH; i++)
+      ioq->req[i].data = ioq->buf + i * SWAP_PAGESZ;
+
+   ioq->dir = 1;
+   pthread_mutex_init(&ioq->lock, NULL);
+   mp->ioq = ioq;
+
+   return 0;
+}
+
+static int swap_ioq_cmp(const void *a, const void *b)
+{
+   addr_t x = ((const struct memphy_ioreq_struct *)a)->swpfpn;
+   addr_t y = ((const struct memphy_ioreq_struct *)b)->swpfpn;
+
+   return (x > y) - (x < y);
+}
+
+/*
+ *  swap_ioq_do_run - transfer requests [first, last] of a sorted queue
+ *  @mp: swap device
+ *  @first: first request of the run
+ *  @last: last request of the run
+ *
+ *  The frames are adjacent, so only the first transfer moves the head.
+ */
+static void swap_ioq_do_run(struct memphy_struct *mp, int first, int last)
+{
+   struct memphy_ioreq_struct *req;
+   int i;
+
+   for (i = first; i <= last; i++)
+   {
+      req = &mp->ioq->req[i];
+      if (req->rw)
+      {
+         MEMPHY_write_block(mp, req->swpfpn * SWAP_PAGESZ, req->data, SWAP_PAGESZ);
+      }
+      else
+      {
+         MEMPHY_read_block(mp, req->swpfpn * SWAP_PAGESZ, req->data, SWAP_PAGESZ);
+         MEMPHY_write_block(req->dstmp, req->dstfpn * SWAP_PAGESZ, req->data, SWAP_PAGESZ);
+      }
+   }
+
+   mp->ioq->nr_dispatch++;
+}
+
+/*
+ *  swap_ioq_dispatch - drain the queue in SCAN order
+ *  @mp: swap device, ioq lock held
+ *
+ *  Runs of adjacent frames at or beyond the head are served in the current
+ *  direction first, then the sweep turns back for the rest.
+ */
+static void swap_ioq_dispatch(struct memphy_struct *mp)
+{
+   struct memphy_ioq_struct *ioq = mp->ioq;
+   int runstart[MEMSWP_IOQ_DEPTH];
+   int runend[MEMSWP_IOQ_DEPTH];
+   int nrun = 0, split, i;
+   addr_t head;
+
+   if (ioq->nr == 0)
+      return;
+
+   qsort(ioq->req, ioq->nr, sizeof(struct memphy_ioreq_struct), swap_ioq_cmp);
+
+   /* Cut the sorted queue into runs of adjacent frames */
+   for (i = 0; i < ioq->nr; i++)
+   {
+      if (nrun > 0 && ioq->req[i].swpfpn == ioq->req[runend[nrun - 1]].swpfpn + 1)
+      {
+         runend[nrun - 1] = i;
+         continue;
+      }
+      runstart[nrun] = runend[nrun] = i;
+      nrun++;
+   }
+
+   /* First run that starts at or beyond the head */
+   head = mp->cursor / SWAP_PAGESZ;
+   for (split = 0; split < nrun; split++)
+      if (ioq->req[runstart[split]].swpfpn >= head)
+         break;
+
+   if (ioq->dir > 0)
+   {
+      for (i = split; i < nrun; i++)
+         swap_ioq_do_run(mp, runstart[i], runend[i]);
+      for (i = split - 1; i >= 0; i--)
+         swap_ioq_do_run(mp, runstart[i], runend[i]);
+      if (split > 0)
+         ioq->dir = -1;
+   }
+   else
+   {
+      for (i = split - 1; i >= 0; i--)
+         swap_ioq_do_run(mp, runstart[i], runend[i]);
+      for (i = split; i < nrun; i++)
+         swap_ioq_do_run(mp, runstart[i], runend[i]);
+      if (split < nrun)
+         ioq->dir = 1;
+   }
+
+   ioq->nr = 0;
+}
+
+/*
+ *  swap_ioq_find - index of the queued write on a swap frame or -1
+ */
+static int swap_ioq_find(struct memphy_ioq_struct *ioq, addr_t swpfpn)
+{
+   int i;
+
+   for (i = 0; i < ioq->nr; i++)
+      if (ioq->req[i].rw && ioq->req[i].swpfpn == swpfpn)
+         return i;
+
+   return -1;
+}
+
+/*
+ *  swap_ioq_remove - drop request i, its staging page goes back to the tail
+ */
+static void swap_ioq_remove(struct memphy_ioq_struct *ioq, int i)
+{
+   struct memphy_ioreq_struct tmp = ioq->req[i];
+
+   ioq->req[i] = ioq->req[ioq->nr - 1];
+   ioq->req[ioq->nr - 1] = tmp;
+   ioq->nr--;
+}
+
+/*
+ *  swap_ioq_write - swap a RAM frame out to a swap frame
+ *  @mp: swap device
+ *  @swpfpn: destination swap frame
+ *  @src: source device (MEMRAM)
+ *  @srcfpn: source frame
+ *
+ *  The page is copied into the queue right away, so the source frame can be
+ *  reused as soon as this returns.
+ */
+int swap_ioq_write(struct memphy_struct *mp, addr_t swpfpn,
+                   struct memphy_struct *src, addr_t srcfpn)
+{
+   struct memphy_ioq_struct *ioq = mp->ioq;
+   int i;
+
+   if (ioq == NULL)
+      return __swap_cp_page(src, srcfpn, mp, swpfpn);
+
+   pthread_mutex_lock(&ioq->lock);
+   ioq->nr_req++;
+
+   /* A newer copy of the same frame replaces the queued one */
+   i = swap_ioq_find(ioq, swpfpn);
+   if (i < 0)
+   {
+      if (ioq->nr == MEMSWP_IOQ_DEPTH)
+         swap_ioq_dispatch(mp);
+      i = ioq->nr++;
+   }
+
+   ioq->req[i].rw = 1;
+   ioq->req[i].swpfpn = swpfpn;
+   MEMPHY_read_block(src, srcfpn * SWAP_PAGESZ, ioq->req[i].data, SWAP_PAGESZ);
+
+   pthread_mutex_unlock(&ioq->lock);
+   return 0;
+}
+
+/*
+ *  swap_ioq_read - swap a page in from a swap frame
+ *  @mp: swap device
+ *  @swpfpn: source swap frame
+ *  @dst: destination device (MEMRAM)
+ *  @dstfpn: destination frame
+ *
+ *  A fault waits for its page, so the read is queued and the whole queue is
+ *  dispatched with it. A read of a frame still waiting to be written is
+ *  served from the queue without touching the device.
+ */
+int swap_ioq_read(struct memphy_struct *mp, addr_t swpfpn,
+                  struct memphy_struct *dst, addr_t dstfpn)
+{
+   struct memphy_ioq_struct *ioq = mp->ioq;
+   struct memphy_ioreq_struct *req;
+   int i;
+
+   if (ioq == NULL)
+      return __swap_cp_page(mp, swpfpn, dst, dstfpn);
+
+   pthread_mutex_lock(&ioq->lock);
+   ioq->nr_req++;
+
+   i = swap_ioq_find(ioq, swpfpn);
+   if (i >= 0)
+   {
+      MEMPHY_write_block(dst, dstfpn * SWAP_PAGESZ, ioq->req[i].data, SWAP_PAGESZ);
+      ioq->nr_hit++;
+      pthread_mutex_unlock(&ioq->lock);
+      return 0;
+   }
+
+   if (ioq->nr == MEMSWP_IOQ_DEPTH)
+      swap_ioq_dispatch(mp);
+
+   req = &ioq->req[ioq->nr++];
+   req->rw = 0;
+   req->swpfpn = swpfpn;
+   req->dstmp = dst;
+   req->dstfpn = dstfpn;
+
+   swap_ioq_dispatch(mp);
+
+   pthread_mutex_unlock(&ioq->lock);
+   return 0;
+}
+
+/*
+ *  swap_dup_slot - let one more page map a swap frame
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ *
+ *  The frame is released by the free of its last mapper.
+ */
+int swap_dup_slot(int swptyp, addr_t swpfpn)
+{
+   struct memphy_struct *mp = swap_get_dev(swptyp);
+   struct swap_info_struct *si;
+
+   if (mp == NULL || swpfpn >= mp->fpnum)
+      return -1;
+
+   si = &swap_info[swptyp];
+   pthread_mutex_lock(&swap_lock);
+   if (si->swap_map == NULL)
+      si->swap_map = calloc(mp->fpnum, sizeof(int));
+   if (si->swap_map == NULL)
+   {
+      pthread_mutex_unlock(&swap_lock);
+      return -1;
+   }
+   si->swap_map[swpfpn]++;
+   pthread_mutex_unlock(&swap_lock);
+
+   return 0;
+}
+
+/*
+ *  swap_free_slot - release a swap frame
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ *
+ *  A frame still mapped by other pages only loses one mapper. Otherwise a
+ *  write still queued for the frame is dropped, its content is dead.
+ */
+int swap_free_slot(int swptyp, addr_t swpfpn)
+{
+   struct memphy_struct *mp = swap_get_dev(swptyp);
+   struct memphy_ioq_struct *ioq;
+   int *map;
+   int i;
+
+   if (mp == NULL)
+      return -1;
+
+   pthread_mutex_lock(&swap_lock);
+   map = swap_info[swptyp].swap_map;
+   if (map != NULL && swpfpn < mp->fpnum && map[swpfpn] > 0)
+   {
+      map[swpfpn]--;
+      pthread_mutex_unlock(&swap_lock);
+      return 0;
+   }
+   pthread_mutex_unlock(&swap_lock);
+
+#ifdef MM_ZSWAP
+   zswap_invalidate(swptyp, swpfpn);
+#endif
+
+   ioq = mp->ioq;
+
+   if (ioq != NULL)
+   {
+      pthread_mutex_lock(&ioq->lock);
+      i = swap_ioq_find(ioq, swpfpn);
+      if (i >= 0)
+         swap_ioq_remove(ioq, i);
+      pthread_mutex_unlock(&ioq->lock);
+   }
+
+   return MEMPHY_put_freefp(mp, swpfpn);
+}
+
+/*
+ *  swap_read_slot - swap a page in from a swap frame of any device
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ *  @dst: destination device (MEMRAM)
+ *  @dstfpn: destination frame
+ */
+int swap_read_slot(int swptyp, addr_t swpfpn, struct memphy_struct *dst, addr_t dstfpn)
+{
+   struct memphy_struct *mp = swap_get_dev(swptyp);
+
+   if (mp == NULL)
+      return -1;
+
+   pthread_mutex_lock(&swap_lock);
+   swap_info[swptyp].nr_swpin++;
+   pthread_mutex_unlock(&swap_lock);
+
+#ifdef MM_ZSWAP
+   /* A page still in the compressed pool never reaches the device */
+   if (zswap_load(swptyp, swpfpn, dst, dstfpn) == 0)
+      return 0;
+#endif
+
+   return swap_ioq_read(mp, swpfpn, dst, dstfpn);
+}
+
+/*
+ *  swap_write_slot - swap a page out to a swap frame of any device
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ *  @src: source device (MEMRAM)
+ *  @srcfpn: source frame
+ */
+int swap_write_slot(int swptyp, addr_t swpfpn, struct memphy_struct *src, addr_t srcfpn)
+{
+   struct memphy_struct *mp = swap_get_dev(swptyp);
+   int ret = -1;
+
+   if (mp == NULL)
+      return -1;
+
+#ifdef MM_ZSWAP
+   /* Spill to the device only when the compressed pool refuses the page */
+   ret = zswap_store(swptyp, swpfpn, src, srcfpn);
+#endif
+
+   if (ret != 0)
+      ret = swap_ioq_write(mp, swpfpn, src, srcfpn);
+   if (ret != 0)
+      return -1;
+
+   /* Counted once written, a failed copy hands its slot back */
+   pthread_mutex_lock(&swap_lock);
+   swap_info[swptyp].nr_swpout++;
+   pthread_mutex_unlock(&swap_lock);
+
+   return 0;
+}
+
+/*
+ *  swap_ioq_flush - write back every queued request
+ *  @mp: swap device
+ */
+int swap_ioq_flush(struct memphy_struct *mp)
+{
+   if (mp == NULL || mp->ioq == NULL)
+      return 0;
+
+   pthread_mutex_lock(&mp->ioq->lock);
+   swap_ioq_dispatch(mp);
+   pthread_mutex_unlock(&mp->ioq->lock);
+
+   return 0;
+}
+
+/*
+ *  swap_ioq_report - print the scheduler statistics of a device
+ *  @mp: swap device
+ *  @id: swap device index
+ */
+void swap_ioq_report(struct memphy_struct *mp, int id)
+{
+   struct memphy_ioq_struct *ioq = mp->ioq;
+   uint64_t nr_seek, seek_dist;
+
+   if (ioq == NULL)
+      return;
+
+   seek_dist = MEMPHY_get_seekdist(mp, &nr_seek);
+   printf("MEMSWP %d: %lu requests, %lu dispatches, %lu queue hits, "
+          "seek distance %lu bytes in %lu seeks\n", id,
+          (unsigned long)ioq->nr_req, (unsigned long)ioq->nr_dispatch,
+          (unsigned long)ioq->nr_hit, (unsigned long)seek_dist,
+          (unsigned long)nr_seek);
+}
+
+/*
+ *  swap_report - flush every swap device and print its usage
+ *
+ *  Devices that never took a page stay quiet.
+ */
+void swap_report(void)
+{
+   struct swap_info_struct *si;
+   int i;
+
+   for (i = 0; i < PAGING_MAX_MMSWP; i++)
+   {
+      si = &swap_info[i];
+      if (si->mp == NULL)
+         continue;
+
+      swap_ioq_flush(si->mp);
+      if (si->nr_swpout == 0)
+         continue;
+
+      printf("MEMSWP %d: prio %d, %d/%d frames used, %lu pages out, %lu pages in\n",
+             i, si->prio, si->mp->fpnum - MEMPHY_nr_freefp(si->mp), si->mp->fpnum,
+             (unsigned long)si->nr_swpout, (unsigned long)si->nr_swpin);
+      swap_ioq_report(si->mp, i);
+   }
+}
+
+// #endif
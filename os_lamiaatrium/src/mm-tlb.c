@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Software TLB mm/mm-tlb.c
+ *
+ * Every simulated CPU owns a set associative TLB caching the PTE of
+ * present pages. Entries are tagged with the address space ID of their
+ * owner, the pid of the process, so a context switch keeps the entries
+ * of the processes that ran before and a process finds its translations
+ * warm when it is dispatched again.
+ *
+ * Each address space records the CPUs it looked up translations on. A PTE
+ * change shoots down the page only on those CPUs, which covers a process
+ * migrated by the scheduler and a page shared with another CPU.
+ *
+ * Lookups and shootdowns run under mmvm_lock, like the page table changes
+ * they follow.
+ */
+
+#include "mm64.h"
+#include <stdio.h>
+#include <string.h>
+
+static struct tlb_struct tlbs[TLB_MAX_CPUS];
+
+/* Simulated CPU the calling thread runs, -1 bypasses the TLB */
+static __thread int tlb_cpuid = -1;
+
+void tlb_set_cpu(int cpuid)
+{
+   tlb_cpuid = (cpuid >= 0 && cpuid < TLB_MAX_CPUS) ? cpuid : -1;
+}
+
+/*
+ *  tlb_lookup - cached PTE of a page
+ *  @mm: address space
+ *  @pgn: page number
+ *  @pte: returned PTE
+ *
+ *  Return 0 on a hit, -1 when the caller has to walk the page table.
+ */
+int tlb_lookup(struct mm_struct *mm, addr_t pgn, pte_t *pte)
+{
+   struct tlb_struct *tlb;
+   struct tlb_entry_struct *set;
+   int way;
+
+   if (tlb_cpuid < 0)
+      return -1;
+
+   tlb = &tlbs[tlb_cpuid];
+   set = tlb->set[pgn % TLB_SETS];
+   for (way = 0; way < TLB_WAYS; way++)
+   {
+      if (set[way].valid && set[way].asid == mm->pid && set[way].pgn == pgn)
+      {
+         *pte = set[way].pte;
+         tlb->nr_hit++;
+         return 0;
+      }
+   }
+
+   tlb->nr_miss++;
+   return -1;
+}
+
+/*
+ *  tlb_insert - cache the PTE of a present page
+ *  @mm: address space
+ *  @pgn: page number
+ *  @pte: PTE read from the page table
+ */
+void tlb_insert(struct mm_struct *mm, addr_t pgn, pte_t pte)
+{
+   struct tlb_struct *tlb;
+   struct tlb_entry_struct *e;
+   int s;
+
+   if (tlb_cpuid < 0 || !PAGING_PAGE_PRESENT(pte) || PAGING_PAGE_SWAPPED(pte))
+      return;
+
+   tlb = &tlbs[tlb_cpuid];
+   mm->tlb_cpumask |= 1U << tlb_cpuid;
+
+   /* Round robin replacement within the set */
+   s = pgn % TLB_SETS;
+   e = &tlb->set[s][tlb->next[s]];
+   tlb->next[s] = (tlb->next[s] + 1) % TLB_WAYS;
+
+   e->asid = mm->pid;
+   e->pgn = pgn;
+   e->pte = pte;
+   e->valid = 1;
+}
+
+/*
+ *  tlb_flush_page - shoot down a page of an address space
+ *  @mm: address space
+ *  @pgn: page number
+ *
+ *  Only the CPUs the address space ran on are visited.
+ */
+void tlb_flush_page(struct mm_struct *mm, addr_t pgn)
+{
+   struct tlb_entry_struct *set;
+   int cpu, way;
+
+   for (cpu = 0; cpu < TLB_MAX_CPUS; cpu++)
+   {
+      if (!(mm->tlb_cpumask & (1U << cpu)))
+         continue;
+
+      set = tlbs[cpu].set[pgn % TLB_SETS];
+      for (way = 0; way < TLB_WAYS; way++)
+      {
+         if (set[way].valid && set[way].asid == mm->pid && set[way].pgn == pgn)
+         {
+            set[way].valid = 0;
+            tlbs[cpu].nr_shootdown++;
+         }
+      }
+   }
+}
+
+/*
+ *  tlb_flush_mm - drop every entry of an address space
+ *  @mm: address space
+ *
+ *  Called before the address space goes away, so its ASID can not hit
+ *  stale entries if it is ever handed out again.
+ */
+void tlb_flush_mm(struct mm_struct *mm)
+{
+   struct tlb_entry_struct *e;
+   int cpu, i;
+
+   for (cpu = 0; cpu < TLB_MAX_CPUS; cpu++)
+   {
+      if (!(mm->tlb_cpumask & (1U << cpu)))
+         continue;
+
+      e = &tlbs[cpu].set[0][0];
+      for (i = 0; i < TLB_SETS * TLB_WAYS; i++)
+         if (e[i].valid && e[i].asid == mm->pid)
+            e[i].valid = 0;
+   }
+
+   mm->tlb_cpumask = 0;
+}
+
+/*
+ *  tlb_report - print hit rates of the CPUs that used their TLB
+ */
+void tlb_report(void)
+{
+   struct tlb_struct *tlb;
+   uint64_t nr;
+   int cpu;
+
+   for (cpu = 0; cpu < TLB_MAX_CPUS; cpu++)
+   {
+      tlb = &tlbs[cpu];
+      nr = tlb->nr_hit + tlb->nr_miss;
+      if (nr == 0)
+         continue;
+
+      printf("TLB CPU %d: %lu lookups, %lu hits (%lu%%), %lu shootdowns\n", cpu,
+             (unsigned long)nr, (unsigned long)tlb->nr_hit,
+             (unsigned long)(tlb->nr_hit * 100 / nr), (unsigned long)tlb->nr_shootdown);
+   }
+}
+
+// #endif
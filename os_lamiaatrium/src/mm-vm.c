@@ -16,6 +16,7 @@
 
 #include "string.h"
 #include "mm.h"
+#include "mm64.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -48,8 +49,7 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
 
 int __mm_swap_page(struct pcb_t *caller, addr_t vicfpn , addr_t swpfpn)
 {
-    __swap_cp_page(caller->krnl->mram, vicfpn, caller->krnl->active_mswp, swpfpn);
-    return 0;
+    return swap_write_slot(caller->krnl->active_mswp_id, swpfpn, caller->krnl->mram, vicfpn);
 }
 
 /*get_vm_area_node - get vm area for a number of pages
@@ -134,29 +134,56 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, a
  */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
 {
-  //struct vm_rg_struct * newrg = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct *area;
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
+  addr_t inc_amt;
 
-  /* TOTO with new address scheme, the size need tobe aligned 
-   *      the raw inc_sz maybe not fit pagesize
-   */ 
-  //addr_t inc_amt;
+  if (cur_vma == NULL)
+    return -1;
 
-//  int incnumpage =  inc_amt / PAGING_PAGESZ;
+  /* With new address scheme, the size need tobe aligned */
+#ifdef MM64
+  inc_amt = PAGING64_PAGE_ALIGNSZ(inc_sz);
+#else
+  inc_amt = PAGING_PAGE_ALIGNSZ(inc_sz);
+#endif
 
-  /* TODO Validate overlap of obtained region */
-  //if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
-  //  return -1; /*Overlap and failed allocation */
+  area = get_vm_area_node_at_brk(caller, vmaid, inc_amt, inc_amt);
 
-  /* TODO: Obtain the new vm area based on vmaid */
-  //cur_vma->vm_end... 
-  // inc_limit_ret...
+  /* Validate overlap of obtained region */
+  if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
+  {
+    free(area);
+    return -1; /*Overlap and failed allocation */
+  }
+
+#ifdef MM_DEMAND_PAGING
+  /* Only the virtual space is reserved, each page gets its frame on
+   * the first touch through pg_getpage
+   */
+#else
   /* The obtained vm area (only)
    * now will be alloc real ram region */
+  struct vm_rg_struct newrg;
+  addr_t old_end = cur_vma->vm_end;
+#ifdef MM64
+  int incnumpage = inc_amt / PAGING64_PAGESZ;
+#else
+  int incnumpage = inc_amt / PAGING_PAGESZ;
+#endif
+
+  if (vm_map_ram(caller, area->rg_start, area->rg_end,
+                 old_end, incnumpage, &newrg) != 0)
+  {
+    free(area);
+    return -1; /* Map the memory to MEMRAM */
+  }
+#endif
 
-//  if (vm_map_ram(caller, area->rg_start, area->rg_end, 
-//                   old_end, incnumpage , newrg) < 0)
-//    return -1; /* Map the memory to MEMRAM */
+  cur_vma->vm_end += inc_amt;
+  cur_vma->sbrk += inc_amt;
 
+  free(area);
   return 0;
 }
 
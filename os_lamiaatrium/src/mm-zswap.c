@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Compressed swap cache mm/mm-zswap.c
+ *
+ * A page on its way to a swap frame is first compressed into a pool of
+ * MEMRAM frames. The pool frames are cut in ZSWAP_CHUNK byte chunks, one
+ * bit per chunk, and a compressed page takes contiguous chunks of a single
+ * frame. Entries are keyed by the swap frame the page was given, so a
+ * swap-in that finds its entry never touches the swap device. Pages that
+ * do not compress well or do not fit go to the device as before.
+ */
+
+#include "mm64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef MM64
+#define ZSWAP_PAGESZ PAGING64_PAGESZ
+#else
+#define ZSWAP_PAGESZ PAGING_PAGESZ
+#endif
+
+/* Larger pages get larger chunks, a frame keeps 64 at most */
+#if ZSWAP_PAGESZ > 4096
+#define ZSWAP_CHUNK (ZSWAP_PAGESZ / 64)
+#else
+#define ZSWAP_CHUNK 64
+#endif
+#define ZSWAP_NCHUNK (ZSWAP_PAGESZ / ZSWAP_CHUNK) /* at most 64, one bitmap word */
+#define ZSWAP_MAX_CLEN (ZSWAP_PAGESZ / 2)         /* keep only pages that halve */
+#define ZSWAP_HSIZE 256
+
+/* LZ codec: LZ4 style sequences of literals followed by a back reference,
+ * on unsigned bytes since BYTE is signed
+ */
+#define ZLZ_MINMATCH 4
+#define ZLZ_LASTLITERALS 5
+#define ZLZ_HASHBITS 12
+
+struct zswap_entry {
+   int swptyp;
+   addr_t swpfpn;
+   int frame;         /* index in the pool */
+   int chunk;         /* first chunk in the frame */
+   int nchunk;
+   int clen;          /* compressed length */
+   struct zswap_entry *next;
+};
+
+static struct {
+   struct memphy_struct *mram;
+   int nframe;
+   addr_t *fpn;       /* MEMRAM frames of the pool */
+   uint64_t *used;    /* one chunk bitmap per pool frame */
+   struct zswap_entry *htab[ZSWAP_HSIZE];
+
+   uint64_t nr_store;
+   uint64_t nr_reject;
+   uint64_t nr_load;
+   uint64_t stored_bytes; /* compressed bytes currently in the pool */
+   uint64_t nr_entry;
+   pthread_mutex_t lock;
+} zswap = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t zlz_read32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+          ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t zlz_hash(uint32_t seq)
+{
+   return (seq * 2654435761U) >> (32 - ZLZ_HASHBITS);
+}
+
+/*
+ *  zlz_put_len - emit the extension bytes of a length that did not fit
+ *  the token nibble
+ */
+static int zlz_put_len(uint8_t *dst, int op, int cap, int len)
+{
+   while (len >= 255)
+   {
+      if (op >= cap)
+         return -1;
+      dst[op++] = 255;
+      len -= 255;
+   }
+   if (op >= cap)
+      return -1;
+   dst[op++] = (uint8_t)len;
+
+   return op;
+}
+
+/*
+ *  zlz_emit - emit one sequence: literals src[anchor, ip) then a match
+ *  @mlen: match length, 0 for the closing literal-only sequence
+ */
+static int zlz_emit(const uint8_t *src, int anchor, int ip, uint8_t *dst, int op, int cap,
+                    int off, int mlen)
+{
+   int lit = ip - anchor;
+   int tok;
+
+   if (op >= cap)
+      return -1;
+
+   tok = op++;
+   dst[tok] = (uint8_t)(((lit < 15) ? lit : 15) << 4);
+   if (lit >= 15 && (op = zlz_put_len(dst, op, cap, lit - 15)) < 0)
+      return -1;
+
+   if (op + lit > cap)
+      return -1;
+   memcpy(dst + op, src + anchor, lit);
+   op += lit;
+
+   if (mlen == 0)
+      return op;
+
+   if (op + 2 > cap)
+      return -1;
+   dst[op++] = off & 0xff;
+   dst[op++] = (off >> 8) & 0xff;
+
+   mlen -= ZLZ_MINMATCH;
+   dst[tok] |= (mlen < 15) ? mlen : 15;
+   if (mlen >= 15 && (op = zlz_put_len(dst, op, cap, mlen - 15)) < 0)
+      return -1;
+
+   return op;
+}
+
+/*
+ *  zlz_compress - compress n bytes of src into dst
+ *  @cap: room in dst
+ *
+ *  Return the compressed length or -1 when it does not fit in cap.
+ */
+static int zlz_compress(const uint8_t *src, int n, uint8_t *dst, int cap)
+{
+   int htab[1 << ZLZ_HASHBITS];
+   int ip = 0, anchor = 0, op = 0;
+   int ref, mlen;
+   uint32_t seq, h;
+
+   memset(htab, 0xff, sizeof(htab));
+
+   while (ip + ZLZ_MINMATCH <= n - ZLZ_LASTLITERALS)
+   {
+      seq = zlz_read32(src + ip);
+      h = zlz_hash(seq);
+      ref = htab[h];
+      htab[h] = ip;
+
+      if (ref < 0 || ip - ref > 0xffff || zlz_read32(src + ref) != seq)
+      {
+         ip++;
+         continue;
+      }
+
+      mlen = ZLZ_MINMATCH;
+      while (ip + mlen < n - ZLZ_LASTLITERALS && src[ref + mlen] == src[ip + mlen])
+         mlen++;
+
+      op = zlz_emit(src, anchor, ip, dst, op, cap, ip - ref, mlen);
+      if (op < 0)
+         return -1;
+
+      ip += mlen;
+      anchor = ip;
+   }
+
+   return zlz_emit(src, anchor, n, dst, op, cap, 0, 0);
+}
+
+/*
+ *  zlz_decompress - expand n bytes of src into dst
+ *  @cap: room in dst
+ *
+ *  Return the expanded length or -1 on a corrupt stream.
+ */
+static int zlz_decompress(const uint8_t *src, int n, uint8_t *dst, int cap)
+{
+   int ip = 0, op = 0;
+   int tok, lit, mlen, off, b;
+
+   while (ip < n)
+   {
+      tok = src[ip++];
+
+      lit = tok >> 4;
+      if (lit == 15)
+         do
+         {
+            if (ip >= n)
+               return -1;
+            b = src[ip++];
+            lit += b;
+         } while (b == 255);
+
+      if (ip + lit > n || op + lit > cap)
+         return -1;
+      memcpy(dst + op, src + ip, lit);
+      ip += lit;
+      op += lit;
+
+      if (ip >= n)
+         break; /* closing literal-only sequence */
+
+      if (ip + 2 > n)
+         return -1;
+      off = src[ip] | (src[ip + 1] << 8);
+      ip += 2;
+
+      mlen = tok & 15;
+      if (mlen == 15)
+         do
+         {
+            if (ip >= n)
+               return -1;
+            b = src[ip++];
+            mlen += b;
+         } while (b == 255);
+      mlen += ZLZ_MINMATCH;
+
+      if (off == 0 || off > op || op + mlen > cap)
+         return -1;
+
+      /* Byte copy, the match may overlap its own output */
+      while (mlen-- > 0)
+      {
+         dst[op] = dst[op - off];
+         op++;
+      }
+   }
+
+   return op;
+}
+
+static struct zswap_entry **zswap_slot(int swptyp, addr_t swpfpn)
+{
+   return &zswap.htab[(swpfpn * PAGING_MAX_MMSWP + swptyp) % ZSWAP_HSIZE];
+}
+
+/*
+ *  zswap_unlink - drop the entry of a swap frame, zswap lock held
+ */
+static void zswap_unlink(int swptyp, addr_t swpfpn)
+{
+   struct zswap_entry **pp = zswap_slot(swptyp, swpfpn);
+   struct zswap_entry *e;
+
+   for (; *pp != NULL; pp = &(*pp)->next)
+   {
+      e = *pp;
+      if (e->swptyp != swptyp || e->swpfpn != swpfpn)
+         continue;
+
+      *pp = e->next;
+      zswap.used[e->frame] &= ~(((e->nchunk == 64) ? ~0ULL : ((1ULL << e->nchunk) - 1)) << e->chunk);
+      zswap.stored_bytes -= e->clen;
+      zswap.nr_entry--;
+      free(e);
+      return;
+   }
+}
+
+/*
+ *  zswap_find_space - first pool frame with nchunk free contiguous chunks
+ */
+static int zswap_find_space(int nchunk, int *frame, int *chunk)
+{
+   uint64_t mask = (nchunk == 64) ? ~0ULL : ((1ULL << nchunk) - 1);
+   int f, c;
+
+   for (f = 0; f < zswap.nframe; f++)
+   {
+      if (zswap.used[f] == ~0ULL)
+         continue;
+
+      for (c = 0; c + nchunk <= ZSWAP_NCHUNK; c++)
+         if (!(zswap.used[f] & (mask << c)))
+         {
+            *frame = f;
+            *chunk = c;
+            return 0;
+         }
+   }
+
+   return -1;
+}
+
+/*
+ *  zswap_init - carve the compressed pool out of MEMRAM
+ *  @mram: MEMRAM device
+ *  @percent: share of MEMRAM frames given to the pool
+ */
+int zswap_init(struct memphy_struct *mram, int percent)
+{
+   int n = mram->fpnum * percent / 100;
+   int i;
+
+   zswap.mram = mram;
+   zswap.fpn = malloc(n * sizeof(addr_t));
+   zswap.used = calloc(n, sizeof(uint64_t));
+   if (zswap.fpn == NULL || zswap.used == NULL)
+   {
+      free(zswap.fpn);
+      free(zswap.used);
+      zswap.fpn = NULL;
+      zswap.used = NULL;
+      return -1;
+   }
+
+   for (i = 0; i < n; i++)
+      if (MEMPHY_get_freefp(mram, &zswap.fpn[i]) != 0)
+         break;
+   zswap.nframe = i;
+
+   return 0;
+}
+
+/*
+ *  zswap_store - compress a page into the pool
+ *  @swptyp: swap type given to the page
+ *  @swpfpn: swap frame given to the page
+ *  @src: source device (MEMRAM)
+ *  @srcfpn: source frame
+ *
+ *  Return 0 when the pool took the page, -1 when it has to go to the device.
+ */
+int zswap_store(int swptyp, addr_t swpfpn, struct memphy_struct *src, addr_t srcfpn)
+{
+   BYTE page[ZSWAP_PAGESZ];
+   BYTE cbuf[ZSWAP_MAX_CLEN];
+   struct zswap_entry *e, **head;
+   int clen, nchunk, frame, chunk;
+
+   if (zswap.nframe == 0)
+      return -1;
+
+   if (MEMPHY_read_block(src, srcfpn * ZSWAP_PAGESZ, page, ZSWAP_PAGESZ) != 0)
+      return -1;
+
+   clen = zlz_compress((uint8_t *)page, ZSWAP_PAGESZ, (uint8_t *)cbuf, ZSWAP_MAX_CLEN);
+
+   pthread_mutex_lock(&zswap.lock);
+
+   /* An older copy of the swap frame is dead either way */
+   zswap_unlink(swptyp, swpfpn);
+
+   if (clen < 0)
+      goto reject;
+
+   nchunk = (clen + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK;
+   if (nchunk == 0)
+      nchunk = 1;
+   if (zswap_find_space(nchunk, &frame, &chunk) != 0)
+      goto reject;
+
+   e = malloc(sizeof(struct zswap_entry));
+   if (e == NULL)
+      goto reject;
+
+   MEMPHY_write_block(zswap.mram, zswap.fpn[frame] * ZSWAP_PAGESZ + chunk * ZSWAP_CHUNK,
+                      cbuf, clen);
+   zswap.used[frame] |= ((nchunk == 64) ? ~0ULL : ((1ULL << nchunk) - 1)) << chunk;
+
+   e->swptyp = swptyp;
+   e->swpfpn = swpfpn;
+   e->frame = frame;
+   e->chunk = chunk;
+   e->nchunk = nchunk;
+   e->clen = clen;
+   head = zswap_slot(swptyp, swpfpn);
+   e->next = *head;
+   *head = e;
+
+   zswap.nr_store++;
+   zswap.nr_entry++;
+   zswap.stored_bytes += clen;
+   pthread_mutex_unlock(&zswap.lock);
+   return 0;
+
+reject:
+   zswap.nr_reject++;
+   pthread_mutex_unlock(&zswap.lock);
+   return -1;
+}
+
+/*
+ *  zswap_load - expand a pooled page into a frame
+ *  @swptyp: swap type of the page
+ *  @swpfpn: swap frame of the page
+ *  @dst: destination device (MEMRAM)
+ *  @dstfpn: destination frame
+ *
+ *  Return 0 on a pool hit, -1 when the page has to come from the device.
+ */
+int zswap_load(int swptyp, addr_t swpfpn, struct memphy_struct *dst, addr_t dstfpn)
+{
+   BYTE page[ZSWAP_PAGESZ];
+   BYTE cbuf[ZSWAP_MAX_CLEN];
+   struct zswap_entry *e;
+
+   pthread_mutex_lock(&zswap.lock);
+   for (e = *zswap_slot(swptyp, swpfpn); e != NULL; e = e->next)
+      if (e->swptyp == swptyp && e->swpfpn == swpfpn)
+         break;
+
+   if (e == NULL)
+   {
+      pthread_mutex_unlock(&zswap.lock);
+      return -1;
+   }
+
+   MEMPHY_read_block(zswap.mram, zswap.fpn[e->frame] * ZSWAP_PAGESZ + e->chunk * ZSWAP_CHUNK,
+                     cbuf, e->clen);
+   if (zlz_decompress((uint8_t *)cbuf, e->clen, (uint8_t *)page, ZSWAP_PAGESZ) != ZSWAP_PAGESZ)
+   {
+      pthread_mutex_unlock(&zswap.lock);
+      return -1;
+   }
+   zswap.nr_load++;
+   pthread_mutex_unlock(&zswap.lock);
+
+   return MEMPHY_write_block(dst, dstfpn * ZSWAP_PAGESZ, page, ZSWAP_PAGESZ);
+}
+
+/*
+ *  zswap_invalidate - forget the pooled copy of a swap frame
+ *  @swptyp: swap type
+ *  @swpfpn: swap frame
+ */
+void zswap_invalidate(int swptyp, addr_t swpfpn)
+{
+   pthread_mutex_lock(&zswap.lock);
+   zswap_unlink(swptyp, swpfpn);
+   pthread_mutex_unlock(&zswap.lock);
+}
+
+/*
+ *  zswap_report - print the pool statistics, quiet when the pool was idle
+ */
+void zswap_report(void)
+{
+   if (zswap.nr_store + zswap.nr_reject == 0)
+      return;
+
+   printf("ZSWAP: %d pool frames, %lu pages stored, %lu rejected, %lu loads, "
+          "%lu pages in %lu bytes now\n", zswap.nframe,
+          (unsigned long)zswap.nr_store, (unsigned long)zswap.nr_reject,
+          (unsigned long)zswap.nr_load, (unsigned long)zswap.nr_entry,
+          (unsigned long)zswap.stored_bytes);
+}
+
+/*
+ *  zswap_exit - drop every entry and give the pool back to MEMRAM
+ */
+void zswap_exit(void)
+{
+   struct zswap_entry *e;
+   int i;
+
+   pthread_mutex_lock(&zswap.lock);
+   for (i = 0; i < ZSWAP_HSIZE; i++)
+      while ((e = zswap.htab[i]) != NULL)
+      {
+         zswap.htab[i] = e->next;
+         free(e);
+      }
+
+   for (i = 0; i < zswap.nframe; i++)
+      MEMPHY_put_freefp(zswap.mram, zswap.fpn[i]);
+
+   free(zswap.fpn);
+   free(zswap.used);
+   zswap.fpn = NULL;
+   zswap.used = NULL;
+   zswap.nframe = 0;
+   pthread_mutex_unlock(&zswap.lock);
+}
+
+// #endif
@@ -60,7 +60,8 @@ int init_pte(addr_t *pte,
 
 
 /*
- * get_pd_from_pagenum - Parse address to 5 page directory level
+ * get_pd_from_address - Parse address to 5 page directory level,
+ *                       the levels a shorter table folds read 0
  * @pgn   : pagenumer
  * @pgd   : page global directory
  * @p4d   : page level directory
@@ -83,7 +84,8 @@ int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr
 }
 
 /*
- * get_pd_from_pagenum - Parse page number to 5 page directory level
+ * get_pd_from_pagenum - Parse page number to 5 page directory level,
+ *                       the levels a shorter table folds read 0
  * @pgn   : pagenumer
  * @pgd   : page global directory
  * @p4d   : page level directory
@@ -98,6 +100,118 @@ int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_
                          pgd,p4d,pud,pmd,pt);
 }
 
+/*
+ * pwc_lookup - PT base of a page from the page walk cache
+ * @mm    : address space
+ * @pgn   : page number
+ * @pt_base : returned PT base
+ *
+ * Page tables are only released with their address space, so an entry
+ * stays valid as long as the mm does.
+ */
+static int pwc_lookup(struct mm_struct *mm, addr_t pgn, addr_t *pt_base)
+{
+  addr_t prefix = pgn >> PAGING64_LEVEL_BITS;
+  int i;
+
+  for (i = 0; i < PWC_ENTRIES; i++) {
+    if (mm->pwc[i].valid && mm->pwc[i].prefix == prefix) {
+      *pt_base = mm->pwc[i].pt_base;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * pwc_insert - remember the PT base a walk resolved
+ * @mm    : address space
+ * @pgn   : page number
+ * @pt_base : PT base of the page
+ */
+static void pwc_insert(struct mm_struct *mm, addr_t pgn, addr_t pt_base)
+{
+  struct pwc_entry_struct *e = &mm->pwc[mm->pwc_next];
+
+  e->prefix = pgn >> PAGING64_LEVEL_BITS;
+  e->pt_base = pt_base;
+  e->valid = 1;
+  mm->pwc_next = (mm->pwc_next + 1) % PWC_ENTRIES;
+}
+
+/*
+ * pgtbl_walk_level - visit the present entries of one table
+ * @base  : table address
+ * @level : table level, 0 for the PGD
+ * @prefix : page number bits above the table index
+ *
+ * A table is read in one block, entries that are not present or fall
+ * outside [start_pgn, end_pgn) are skipped along with their subtree.
+ */
+static int pgtbl_walk_level(struct mm_struct *mm, struct memphy_struct *mp, addr_t base,
+                            int level, addr_t prefix, addr_t start_pgn, addr_t end_pgn,
+                            const struct pgtbl_walk_ops *ops)
+{
+  pte_t entries[PAGING64_PTE_PER_PT];
+  int shift = PAGING64_LEVEL_BITS * (PAGING64_PT_LEVEL - level);
+  addr_t idx, pgn, child;
+  int ret;
+
+  if (MEMPHY_read64_array(mp, base, entries, PAGING64_PTE_PER_PT) != 0)
+    return -1;
+
+  for (idx = 0; idx < PAGING64_PTE_PER_PT; idx++) {
+    pgn = (prefix * PAGING64_PTE_PER_PT + idx) << shift;
+    if (pgn >= end_pgn)
+      break;
+    if (pgn + ((addr_t)1 << shift) <= start_pgn || !PAGING_PAGE_PRESENT(entries[idx]))
+      continue;
+
+    ret = 0;
+    if (level == PAGING64_PT_LEVEL) {
+      if (ops->pte_entry != NULL)
+        ret = ops->pte_entry(mm, pgn, entries[idx], base + idx * PAGING64_PTESZ, ops->priv);
+    } else if (level == PAGING64_PMD_LEVEL && PAGING_PAGE_HUGE(entries[idx])) {
+      if (ops->huge_entry != NULL)
+        ret = ops->huge_entry(mm, pgn, entries[idx], base + idx * PAGING64_PTESZ, ops->priv);
+    } else {
+      child = PAGING_PTE_FPN(entries[idx]) * PAGING64_PAGESZ;
+      ret = pgtbl_walk_level(mm, mp, child, level + 1, prefix * PAGING64_PTE_PER_PT + idx,
+                             start_pgn, end_pgn, ops);
+    }
+
+    if (ret != 0)
+      return ret;
+  }
+
+  if (ops->table_exit != NULL)
+    return ops->table_exit(mm, base / PAGING64_PAGESZ, level, ops->priv);
+
+  return 0;
+}
+
+/*
+ * pgtbl_walk - visit the mapped pages of an address space
+ * @mm    : address space
+ * @mp    : MEMRAM holding the tables
+ * @start_pgn : first page number
+ * @end_pgn   : page number past the range
+ * @ops   : callbacks
+ *
+ * Only present directories are descended, so the cost follows the
+ * mapped pages rather than the size of the range. Entries are seen in
+ * page number order and a table is left after all of its children.
+ */
+int pgtbl_walk(struct mm_struct *mm, struct memphy_struct *mp, addr_t start_pgn, addr_t end_pgn,
+               const struct pgtbl_walk_ops *ops)
+{
+  if (mm->pgd == NULL || start_pgn >= end_pgn)
+    return 0;
+
+  return pgtbl_walk_level(mm, mp, (addr_t)mm->pgd, 0, 0, start_pgn, end_pgn, ops);
+}
+
 /*
  * pte_set_swap - Set PTE entry for swapped page
  * @pte    : target page table entry (PTE)
@@ -116,7 +230,7 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
   }
   
   // Read current PTE value
-  addr_t pte_value = get_32bit_entry(pte_addr, krnl->mram);
+  addr_t pte_value = get_64bit_entry(pte_addr, krnl->mram);
   
 #else
   addr_t pte_addr = (addr_t)&krnl->mm->pgd[pgn];
@@ -126,137 +240,162 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
   // Modify the PTE
   SETBIT(pte_value, PAGING_PTE_PRESENT_MASK);
   SETBIT(pte_value, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(pte_value, PAGING_PTE_COW_MASK);
   SETVAL(pte_value, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
   SETVAL(pte_value, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
 
   // Write back to memory
-  for (int i = 0; i < 4; i++) {
-    BYTE byte_val = (pte_value >> (i * 8)) & 0xFF;
-    MEMPHY_write(krnl->mram, pte_addr + i, byte_val);
-  }
+  MEMPHY_write64(krnl->mram, pte_addr, pte_value);
+  tlb_flush_page(krnl->mm, pgn);
 
   return 0;
 }
 /*
- * pte_set_fpn - Set PTE entry for on-line page
- * @pte   : target page table entry (PTE)
- * @fpn   : frame page number (FPN)
+ * pgtbl_entry_addr - walk down to the entry of a page at a table level
+ * @mm       : address space
+ * @mp       : MEMRAM holding the tables
+ * @pgn      : page number
+ * @level    : level of the entry, 0 for the PGD
+ * @alloc    : allocate the tables missing on the way
+ * @entry_addr : returned address of the entry
+ *
+ * The depth is a compile time constant, so the loop unrolls into the
+ * walk of the configured table. Return -1 on a missing table that was
+ * not or could not be allocated.
  */
-int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
+static int pgtbl_entry_addr(struct mm_struct *mm, struct memphy_struct *mp, addr_t pgn,
+                            int level, int alloc, addr_t *entry_addr)
 {
-  struct krnl_t *krnl = caller->krnl;
-
-#ifdef MM64	
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
-
-  // Level 1: PGD
-  addr_t pgd_base = (addr_t)krnl->mm->pgd;
-  addr_t pgd_entry = get_32bit_entry(pgd_base + pgd_idx * 4, krnl->mram);
-  
-  // Allocate P4D table if not present
-  if (!(pgd_entry & PAGING_PTE_PRESENT_MASK)) {
-    addr_t p4d_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &p4d_fpn) != 0) return -1;
-    
-    pgd_entry = 0;
-    SETBIT(pgd_entry, PAGING_PTE_PRESENT_MASK);
-    SETVAL(pgd_entry, p4d_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
-    
-    // Write PGD entry
-    for (int i = 0; i < 4; i++) {
-      BYTE byte_val = (pgd_entry >> (i * 8)) & 0xFF;
-      MEMPHY_write(krnl->mram, pgd_base + pgd_idx * 4 + i, byte_val);
+  addr_t base = (addr_t)mm->pgd;
+  addr_t addr, fpn;
+  pte_t entry;
+  int lv;
+
+  for (lv = 0; lv < level; lv++) {
+    addr = base + PAGING64_PGN_IDX(pgn, lv) * PAGING64_PTESZ;
+    entry = get_64bit_entry(addr, mp);
+
+    // Allocate the next table if not present
+    if (!PAGING_PAGE_PRESENT(entry)) {
+      if (!alloc || MEMPHY_get_zerofp(mp, &fpn) != 0) return -1;
+      MEMPHY_set_rmap(mp, fpn, mm, MEMPHY_RMAP_PGTBL);
+
+      entry = 0;
+      SETBIT(entry, PAGING_PTE_PRESENT_MASK);
+      SETVAL(entry, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+      MEMPHY_write64(mp, addr, entry);
     }
-  }
-  
-  addr_t p4d_base = (pgd_entry & 0x1FFF) * PAGING64_PAGESZ;
 
-  // Level 2: P4D
-  addr_t p4d_entry = get_32bit_entry(p4d_base + p4d_idx * 4, krnl->mram);
-  
-  // Allocate PUD table if not present
-  if (!(p4d_entry & PAGING_PTE_PRESENT_MASK)) {
-    addr_t pud_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pud_fpn) != 0) return -1;
-    
-    p4d_entry = 0;
-    SETBIT(p4d_entry, PAGING_PTE_PRESENT_MASK);
-    SETVAL(p4d_entry, pud_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
-    
-    // Write P4D entry
-    for (int i = 0; i < 4; i++) {
-      BYTE byte_val = (p4d_entry >> (i * 8)) & 0xFF;
-      MEMPHY_write(krnl->mram, p4d_base + p4d_idx * 4 + i, byte_val);
-    }
+    base = PAGING_PTE_FPN(entry) * PAGING64_PAGESZ;
   }
-  
-  addr_t pud_base = (p4d_entry & 0x1FFF) * PAGING64_PAGESZ;
 
-  // Level 3: PUD
-  addr_t pud_entry = get_32bit_entry(pud_base + pud_idx * 4, krnl->mram);
-  
-  // Allocate PMD table if not present
-  if (!(pud_entry & PAGING_PTE_PRESENT_MASK)) {
-    addr_t pmd_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pmd_fpn) != 0) return -1;
-    
-    pud_entry = 0;
-    SETBIT(pud_entry, PAGING_PTE_PRESENT_MASK);
-    SETVAL(pud_entry, pmd_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
-    
-    // Write PUD entry
-    for (int i = 0; i < 4; i++) {
-      BYTE byte_val = (pud_entry >> (i * 8)) & 0xFF;
-      MEMPHY_write(krnl->mram, pud_base + pud_idx * 4 + i, byte_val);
-    }
-  }
-  
-  addr_t pmd_base = (pud_entry & 0x1FFF) * PAGING64_PAGESZ;
+  *entry_addr = base + PAGING64_PGN_IDX(pgn, level) * PAGING64_PTESZ;
+  return 0;
+}
+
+/*
+ * pmd_alloc - walk down to the PMD entry of a page, allocating the
+ *             upper tables that are missing on the way
+ * @mm       : address space
+ * @mp       : MEMRAM holding the tables
+ * @pgn      : page number
+ * @pmd_addr : returned address of the PMD entry
+ */
+static int pmd_alloc(struct mm_struct *mm, struct memphy_struct *mp, addr_t pgn, addr_t *pmd_addr)
+{
+  return pgtbl_entry_addr(mm, mp, pgn, PAGING64_PMD_LEVEL, 1, pmd_addr);
+}
+
+/*
+ * pt_alloc - find the PT of a page, allocating the missing tables
+ * @mm      : address space
+ * @mp      : MEMRAM holding the tables
+ * @pgn     : page number
+ * @pt_base : returned PT base
+ */
+static int pt_alloc(struct mm_struct *mm, struct memphy_struct *mp, addr_t pgn, addr_t *pt_base)
+{
+  addr_t pmd_addr;
+
+  // A recent walk of the same PMD prefix already resolved the PT
+  if (pwc_lookup(mm, pgn, pt_base) == 0) return 0;
+
+  if (pmd_alloc(mm, mp, pgn, &pmd_addr) != 0) return -1;
 
   // Level 4: PMD
-  addr_t pmd_entry = get_32bit_entry(pmd_base + pmd_idx * 4, krnl->mram);
+  addr_t pmd_entry = get_64bit_entry(pmd_addr, mp);
+
+  // A huge page has no PTE of its own to set
+  if (PAGING_PAGE_HUGE(pmd_entry)) return -1;
   
   // Allocate PT table if not present
   if (!(pmd_entry & PAGING_PTE_PRESENT_MASK)) {
     addr_t pt_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pt_fpn) != 0) return -1;
+    if (MEMPHY_get_zerofp(mp, &pt_fpn) != 0) return -1;
+    MEMPHY_set_rmap(mp, pt_fpn, mm, MEMPHY_RMAP_PGTBL);
     
     pmd_entry = 0;
     SETBIT(pmd_entry, PAGING_PTE_PRESENT_MASK);
     SETVAL(pmd_entry, pt_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
     
     // Write PMD entry
-    for (int i = 0; i < 4; i++) {
-      BYTE byte_val = (pmd_entry >> (i * 8)) & 0xFF;
-      MEMPHY_write(krnl->mram, pmd_base + pmd_idx * 4 + i, byte_val);
-    }
+    MEMPHY_write64(mp, pmd_addr, pmd_entry);
   }
   
-  addr_t pt_base = (pmd_entry & 0x1FFF) * PAGING64_PAGESZ;
+  *pt_base = PAGING_PTE_FPN(pmd_entry) * PAGING64_PAGESZ;
+  pwc_insert(mm, pgn, *pt_base);
+
+  return 0;
+}
+
+/*
+ * pte_fill_fpn - turn a PTE into a private writable mapping of a frame,
+ *                without any swap offset left over from a swapped state
+ * @pte   : page table entry
+ * @fpn   : frame page number (FPN)
+ */
+static void pte_fill_fpn(pte_t *pte, addr_t fpn)
+{
+  SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+  CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_COW_MASK);
+  CLRBIT(*pte, PAGING_PTE_SWPOFF_MASK);
+  SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+}
+
+/*
+ * pte_set_fpn - Set PTE entry for on-line page
+ * @pte   : target page table entry (PTE)
+ * @fpn   : frame page number (FPN)
+ */
+int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
+{
+  struct krnl_t *krnl = caller->krnl;
 
-  // Level 5: PT - Get PTE address
-  addr_t pte_addr = pt_base + pt_idx * 4;
+#ifdef MM64	
+  addr_t pt_idx = PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL);
+  addr_t pt_base;
+
+  if (pt_alloc(krnl->mm, krnl->mram, pgn, &pt_base) != 0) return -1;
+
+  // Last level: PT - Get PTE address
+  addr_t pte_addr = pt_base + pt_idx * PAGING64_PTESZ;
   
   // Read current PTE value (may be 0 if new)
-  addr_t pte_value = get_32bit_entry(pte_addr, krnl->mram);
+  pte_t pte_value = get_64bit_entry(pte_addr, krnl->mram);
   
 #else
   // 32-bit version - direct access
   addr_t pte_addr = (addr_t)&krnl->mm->pgd[pgn];
-  addr_t pte_value = krnl->mm->pgd[pgn];
+  pte_t pte_value = krnl->mm->pgd[pgn];
 #endif
 
   // Modify the PTE value
-  SETBIT(pte_value, PAGING_PTE_PRESENT_MASK);
-  CLRBIT(pte_value, PAGING_PTE_SWAPPED_MASK);
-  SETVAL(pte_value, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  pte_fill_fpn(&pte_value, fpn);
 
   // Write the modified PTE back to physical memory
-  for (int i = 0; i < 4; i++) {
-    BYTE byte_val = (pte_value >> (i * 8)) & 0xFF;
-    MEMPHY_write(krnl->mram, pte_addr + i, byte_val);
-  }
+  MEMPHY_write64(krnl->mram, pte_addr, pte_value);
+  tlb_flush_page(krnl->mm, pgn);
 
   return 0;
 }
@@ -542,35 +681,46 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
+pte_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
 {
   struct krnl_t *krnl = caller->krnl;  // Uncomment this!
   
-  uint32_t pte = 0;
+  pte_t pte = 0;
+
+#ifdef MM_TLB
+  if (tlb_lookup(krnl->mm, pgn, &pte) == 0)
+    return pte;
+#endif
   
 #ifdef MM64
-  addr_t pgd_idx = 0;
-  addr_t p4d_idx = 0;
-  addr_t pud_idx = 0;
-  addr_t pmd_idx = 0;
-  addr_t pt_idx = 0;
-	
-  /* Get indices from page number */
-  get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
+  /* Index of the page in its PT */
+  addr_t pt_idx = PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL);
   
   /* Use helper function to get PTE address */
   addr_t pte_addr;
-  if (get_pte_address(krnl->mm, krnl->mram, pgn, &pte_addr) != 0) {
+  int ret = get_pte_address(krnl->mm, krnl->mram, pgn, &pte_addr);
+  if (ret < 0) {
     return 0;  // Return 0 if page table doesn't exist
   }
   
   /* Read and return the PTE value */
-  pte = get_32bit_entry(pte_addr, krnl->mram);
+  pte = get_64bit_entry(pte_addr, krnl->mram);
+
+  /* A huge page stands for one PTE per 4KB page of its frame run */
+  if (ret == 1) {
+    addr_t fpn = PAGING_PTE_FPN(pte) + pt_idx;
+    CLRBIT(pte, PAGING_PTE_HUGE_MASK);
+    SETVAL(pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  }
   
 #else
   // 32-bit version - direct access
   pte = krnl->mm->pgd[pgn];
 #endif
+
+#ifdef MM_TLB
+  tlb_insert(krnl->mm, pgn, pte);
+#endif
 	
   return pte;
 }
@@ -580,7 +730,7 @@ uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
  * @pgn     : page number
  * @pte_val : page table entry value to set
  **/
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, pte_t pte_val)
 {
   struct krnl_t *krnl = caller->krnl;
   
@@ -592,15 +742,13 @@ int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
   }
   
   /* Write the PTE value to physical memory */
-  for (int i = 0; i < 4; i++) {
-    BYTE byte_val = (pte_val >> (i * 8)) & 0xFF;
-    MEMPHY_write(krnl->mram, pte_addr + i, byte_val);
-  }
+  MEMPHY_write64(krnl->mram, pte_addr, pte_val);
   
 #else
   // 32-bit version - direct access
   krnl->mm->pgd[pgn] = pte_val;
 #endif
+  tlb_flush_page(krnl->mm, pgn);
 	
   return 0;
 }
@@ -637,8 +785,11 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
 {
   struct krnl_t *krnl = caller->krnl;
   struct framephy_struct *fpit = frames;
+  pte_t ptes[PAGING64_PTE_PER_PT];
+  addr_t pt_idx;
+  addr_t pgn, pt_base;
   int pgit = 0;
-  addr_t pgn;
+  int nr, i;
 
   /* Update the return region with mapped range */
   ret_rg->rg_start = addr;
@@ -647,23 +798,44 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
   /* Calculate starting page number */
   addr_t start_pgn = addr >> PAGING64_ADDR_PT_SHIFT;
 
-  /* Map each frame to corresponding page */
-  for (pgit = 0; pgit < pgnum && fpit != NULL; pgit++, fpit = fpit->fp_next) {
+  /* Walk once per PT, then fill the run of its PTEs in one block */
+  while (pgit < pgnum && fpit != NULL) {
     pgn = start_pgn + pgit;
-    
-    /* Set the PTE with the frame's FPN */
-    if (pte_set_fpn(caller, pgn, fpit->fpn) != 0) {
-      // If mapping fails, return how many pages were successfully mapped
-      ret_rg->rg_end = addr + pgit * PAGING64_PAGESZ;
-      return pgit;
-    }
+    pt_idx = PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL);
+
+    if (pt_alloc(krnl->mm, krnl->mram, pgn, &pt_base) != 0)
+      break;
+
+    nr = PAGING64_PTE_PER_PT - pt_idx;
+    if (nr > pgnum - pgit)
+      nr = pgnum - pgit;
+
+    if (MEMPHY_read64_array(krnl->mram, pt_base + pt_idx * PAGING64_PTESZ, ptes, nr) != 0)
+      break;
+
+    /* Map each frame to corresponding page */
+    for (i = 0; i < nr && fpit != NULL; i++, fpit = fpit->fp_next) {
+      /* Only a page that was present may be cached in a TLB */
+      if (PAGING_PAGE_PRESENT(ptes[i]))
+        tlb_flush_page(krnl->mm, pgn + i);
+
+      pte_fill_fpn(&ptes[i], fpit->fpn);
+      MEMPHY_set_rmap(krnl->mram, fpit->fpn, krnl->mm, pgn + i);
 
 #ifdef MM_PAGING
-    /* Tracking for page replacement (if needed) */
-    enlist_pgn_node(&krnl->mm->fifo_pgn, pgn);
+      /* Tracking for page replacement (if needed) */
+      enlist_pgn_node(&krnl->mm->fifo_pgn, pgn + i);
 #endif
+    }
+
+    MEMPHY_write64_array(krnl->mram, pt_base + pt_idx * PAGING64_PTESZ, ptes, i);
+    pgit += i;
   }
 
+  // If mapping fails, return how many pages were successfully mapped
+  if (pgit < pgnum)
+    ret_rg->rg_end = addr + pgit * PAGING64_PAGESZ;
+
   /* Return number of pages actually mapped */
   return pgit;
 }
@@ -710,6 +882,55 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
 //   return pgit;
 // }
 
+/*
+ * vmap_huge_range - map huge page aligned chunks with PMD leaf entries
+ * @caller : process call
+ * @addr   : start address aligned to PAGING64_HUGESZ
+ * @hpnum  : number of huge pages
+ *
+ * Each chunk takes one physically contiguous run of frames and no PT at
+ * all. Mapping stops at the first chunk without such a run, the return
+ * value is the number of chunks mapped from addr on.
+ */
+int vmap_huge_range(struct pcb_t *caller, addr_t addr, int hpnum)
+{
+  struct krnl_t *krnl = caller->krnl;
+  addr_t pgn, pmd_addr, pmd_entry, fpn;
+  int hpit, pgit;
+
+  for (hpit = 0; hpit < hpnum; hpit++) {
+    pgn = (addr + hpit * PAGING64_HUGESZ) >> PAGING64_ADDR_PT_SHIFT;
+
+    /* Fragmented or small MEMRAM, the rest goes page by page */
+    if (MEMPHY_nr_freefp(krnl->mram) < PAGING64_HUGE_PGNUM + PAGING64_PMD_LEVEL)
+      break;
+
+    if (pmd_alloc(krnl->mm, krnl->mram, pgn, &pmd_addr) != 0)
+      break;
+
+    /* The range was never mapped, but a PT may be left from a memset */
+    pmd_entry = get_64bit_entry(pmd_addr, krnl->mram);
+    if (PAGING_PAGE_PRESENT(pmd_entry))
+      break;
+
+    if (MEMPHY_get_zerofp_range(krnl->mram, PAGING64_HUGE_PGNUM, &fpn) != 0)
+      break;
+
+    for (pgit = 0; pgit < PAGING64_HUGE_PGNUM; pgit++)
+      MEMPHY_set_rmap(krnl->mram, fpn + pgit, krnl->mm, pgn + pgit);
+
+    pmd_entry = 0;
+    SETBIT(pmd_entry, PAGING_PTE_PRESENT_MASK);
+    SETBIT(pmd_entry, PAGING_PTE_HUGE_MASK);
+    SETVAL(pmd_entry, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    MEMPHY_write64(krnl->mram, pmd_addr, pmd_entry);
+
+    /* Huge pages stay resident, they are not put on the FIFO list */
+  }
+
+  return hpit;
+}
+
 /*
  * alloc_pages_range - allocate req_pgnum of frame in ram
  * @caller    : caller
@@ -730,8 +951,12 @@ addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_st
 
   /* Allocate frames one by one */
   for (pgit = 0; pgit < req_pgnum; pgit++){
-    /* Try to get a free frame from physical memory */
-    if (MEMPHY_get_freefp(krnl->mram, &fpn) == 0){
+    /* Try to get a cleared frame from physical memory, else swap a
+     * victim page out and take over its frame
+     */
+    if (MEMPHY_get_zerofp(krnl->mram, &fpn) == 0 ||
+        (pg_reclaim_frame(caller, &fpn) == 0 &&
+         MEMPHY_clear_frame(krnl->mram, fpn) == 0)){
       /* Create new frame node */
       newfp_str = (struct framephy_struct *)malloc(sizeof(struct framephy_struct));
       if (newfp_str == NULL) {
@@ -741,6 +966,7 @@ addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_st
       
       newfp_str->fpn = fpn;
       newfp_str->fp_next = NULL;
+      newfp_str->owner = krnl->mm;
 
       /* Build the linked list */
       if (*frm_lst == NULL) {
@@ -842,8 +1068,46 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend,
   struct framephy_struct *frm_lst = NULL;
   int ret_alloc = 0;
 
+#ifdef MM_HUGEPAGE
+  /* Map the huge page aligned middle of a large range with huge pages, the
+   * unaligned head and tail and whatever could not get a contiguous
+   * run still go down to the PT
+   */
+  addr_t mapend = mapstart + incpgnum * PAGING64_PAGESZ;
+  addr_t hstart = DIV_ROUND_UP(mapstart, PAGING64_HUGESZ) * PAGING64_HUGESZ;
+  addr_t hend = (mapend / PAGING64_HUGESZ) * PAGING64_HUGESZ;
+
+  if (hstart < hend) {
+    int hpnum = vmap_huge_range(caller, hstart, (hend - hstart) / PAGING64_HUGESZ);
+
+    if (hpnum > 0) {
+      addr_t hmapped = hstart + hpnum * PAGING64_HUGESZ;
+      struct vm_rg_struct rg;
+
+      if (hstart > mapstart &&
+          vm_map_ram(caller, astart, aend, mapstart,
+                     (hstart - mapstart) / PAGING64_PAGESZ, &rg) != 0)
+        return -1;
+      if (mapend > hmapped &&
+          vm_map_ram(caller, astart, aend, hmapped,
+                     (mapend - hmapped) / PAGING64_PAGESZ, &rg) != 0)
+        return -1;
+
+      ret_rg->rg_start = mapstart;
+      ret_rg->rg_end = mapend;
+      return 0;
+    }
+  }
+#endif
+
+  /* Reclaim from every process first when MEMRAM is short, counting
+   * the P4D/PUD/PMD/PT tables a fresh walk may have to allocate
+   */
+  kswapd_direct_reclaim(incpgnum + 4);
+
   /* Allocate physical frames */
   ret_alloc = alloc_pages_range(caller, incpgnum, &frm_lst);
+  kswapd_wakeup();
 
   /* Check allocation result */
   if (ret_alloc < 0 && ret_alloc != -3000) {
@@ -857,8 +1121,7 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend,
 
   /* Check if we got enough frames */
   if (ret_alloc < incpgnum) {
-    /* Partial allocation - not enough frames available
-     * Could implement swapping here, but for simplicity we fail */
+    /* Partial allocation - nothing left to reclaim either */
     free_frame_list(caller, frm_lst);
     return -1;
   }
@@ -873,6 +1136,13 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend,
     return -1;
   }
 
+  /* The frames belong to the page table now, only drop the list nodes */
+  while (frm_lst != NULL) {
+    struct framephy_struct *next = frm_lst->fp_next;
+    free(frm_lst);
+    frm_lst = next;
+  }
+
   return 0;
 }
 
@@ -937,19 +1207,12 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend,
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                    struct memphy_struct *mpdst, addr_t dstfpn)
 {
-  int cellidx;
-  addr_t addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
+  BYTE data[PAGING64_PAGESZ];
 
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
+  if (MEMPHY_read_block(mpsrc, srcfpn * PAGING64_PAGESZ, data, PAGING64_PAGESZ) != 0)
+    return -1;
 
-  return 0;
+  return MEMPHY_write_block(mpdst, dstfpn * PAGING64_PAGESZ, data, PAGING64_PAGESZ);
 }
 
 /*
@@ -962,22 +1225,21 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   struct krnl_t *krnl = caller->krnl;
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
 
+  /* Owner first, the rmap entry of every table frame records it */
+  mm->pid = caller->pid;
+
 #ifdef MM64
   /* Initialize page table directory for 64-bit */
   addr_t pgd_fpn;
   
-  // Allocate physical frame for PGD
-  if (MEMPHY_get_freefp(krnl->mram, &pgd_fpn) != 0) {
+  // Allocate an already cleared physical frame for PGD
+  if (MEMPHY_get_zerofp(krnl->mram, &pgd_fpn) != 0) {
     free(vma0);  // Clean up allocated vma0
+    memset(mm, 0, sizeof(struct mm_struct));  // Still safe to tear down
     return -1;  // Out of memory
   }
   mm->pgd = (addr_t *)(pgd_fpn * PAGING64_PAGESZ);
-  
-  // Zero out the PGD frame (clear any garbage data)
-  addr_t pgd_base = (addr_t)mm->pgd;
-  for (int i = 0; i < PAGING64_PAGESZ; i++) {
-    MEMPHY_write(krnl->mram, pgd_base + i, 0);
-  }
+  MEMPHY_set_rmap(krnl->mram, pgd_fpn, mm, MEMPHY_RMAP_PGTBL);
   
   // Lazy allocation for other levels
   mm->p4d = NULL;
@@ -988,21 +1250,19 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 #else
   /* 32-bit version */
   addr_t pgd_fpn;
-  if (MEMPHY_get_freefp(krnl->mram, &pgd_fpn) != 0) {
+  if (MEMPHY_get_zerofp(krnl->mram, &pgd_fpn) != 0) {
     free(vma0);
     return -1;
   }
   mm->pgd = (uint32_t *)(pgd_fpn * PAGING_PAGESZ);
-  
-  // Zero out the PGD
-  addr_t pgd_base = (addr_t)mm->pgd;
-  for (int i = 0; i < PAGING_PAGESZ; i++) {
-    MEMPHY_write(krnl->mram, pgd_base + i, 0);
-  }
+  MEMPHY_set_rmap(krnl->mram, pgd_fpn, mm, MEMPHY_RMAP_PGTBL);
 #endif
 
   /* Initialize FIFO page list for page replacement */
   mm->fifo_pgn = NULL;
+  mm->tlb_cpumask = 0;
+  memset(mm->pwc, 0, sizeof(mm->pwc));
+  mm->pwc_next = 0;
 
   /* Initialize symbol region table */
   memset(mm->symrgtbl, 0, sizeof(struct vm_rg_struct) * PAGING_MAX_SYMTBL_SZ);
@@ -1014,6 +1274,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->sbrk = vma0->vm_start;
   
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
+  vma0->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
   /* Update VMA0 next - initially NULL (only one VMA) */
@@ -1028,6 +1289,266 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+/*
+ * Teardown state: the run of contiguous frames not released yet
+ */
+struct exit_mm_state {
+  struct memphy_struct *mp;
+  addr_t run_fpn;
+  int run_nr;
+};
+
+static void exit_mm_flush(struct exit_mm_state *st)
+{
+  if (st->run_nr > 0)
+    MEMPHY_put_freefp_range(st->mp, st->run_fpn, st->run_nr);
+  st->run_nr = 0;
+}
+
+/*
+ * exit_mm_pte - release the page behind a present PTE
+ *
+ * Swapped pages give their slot back, resident frames that follow each
+ * other go back as one run.
+ */
+static int exit_mm_pte(struct mm_struct *mm, addr_t pgn, pte_t pte, addr_t pte_addr, void *priv)
+{
+  struct exit_mm_state *st = priv;
+  addr_t fpn;
+
+  if (PAGING_PAGE_SWAPPED(pte)) {
+    swap_free_slot(PAGING_SWPTYP(pte), PAGING_SWP(pte));
+    return 0;
+  }
+
+  /* A merged frame goes back with the last page mapping it */
+  fpn = PAGING_PTE_FPN(pte);
+  if (ksm_mapcount(fpn) > 0 && ksm_unmap(mm, pgn, fpn) != 0)
+    return 0;
+
+  if (st->run_nr > 0 && fpn == st->run_fpn + st->run_nr) {
+    st->run_nr++;
+    return 0;
+  }
+
+  exit_mm_flush(st);
+  st->run_fpn = fpn;
+  st->run_nr = 1;
+  return 0;
+}
+
+static int exit_mm_huge(struct mm_struct *mm, addr_t pgn, pte_t pmd, addr_t pmd_addr, void *priv)
+{
+  struct exit_mm_state *st = priv;
+
+  MEMPHY_put_freefp_range(st->mp, PAGING_PTE_FPN(pmd), PAGING64_HUGE_PGNUM);
+  return 0;
+}
+
+/* Tables go back once their children are gone */
+static int exit_mm_table(struct mm_struct *mm, addr_t fpn, int level, void *priv)
+{
+  struct exit_mm_state *st = priv;
+
+  exit_mm_flush(st);
+  MEMPHY_put_freefp(st->mp, fpn);
+  return 0;
+}
+
+/*
+ * exit_mm - tear down an address space
+ * @mm    : address space of a finished process
+ * @mram  : MEMRAM holding its tables
+ *
+ * Walks the five level table once, giving back data frames, huge pages,
+ * swap slots and the tables themselves, then the vm areas and the FIFO
+ * list. The mm_struct itself is left to the caller.
+ */
+int exit_mm(struct mm_struct *mm, struct memphy_struct *mram)
+{
+  struct exit_mm_state st = { .mp = mram };
+  const struct pgtbl_walk_ops ops = {
+    .pte_entry = exit_mm_pte,
+    .huge_entry = exit_mm_huge,
+    .table_exit = exit_mm_table,
+    .priv = &st,
+  };
+  struct vm_area_struct *vma;
+  struct vm_rg_struct *rg;
+  struct pgn_t *pg;
+
+  tlb_flush_mm(mm);
+
+  pgtbl_walk(mm, mram, 0, (addr_t)-1, &ops);
+  mm->pgd = NULL;
+  memset(mm->pwc, 0, sizeof(mm->pwc));
+
+  /* Nothing is left to evict */
+  while ((pg = mm->fifo_pgn) != NULL) {
+    mm->fifo_pgn = pg->pg_next;
+    free(pg);
+  }
+
+  while ((vma = mm->mmap) != NULL) {
+    mm->mmap = vma->vm_next;
+    while ((rg = vma->vm_freerg_list) != NULL) {
+      vma->vm_freerg_list = rg->rg_next;
+      free(rg);
+    }
+    free(vma);
+  }
+
+  return 0;
+}
+
+/*
+ * Fork state: the address space taking the copy
+ */
+struct dup_mm_state {
+  struct mm_struct *newmm;
+  struct memphy_struct *mp;
+};
+
+/*
+ * dup_mm_pte - share the page behind a present PTE with the child
+ *
+ * A resident frame is mapped copy on write by both tables, a swapped page
+ * shares its swap slot. The child PT is found first, so a failure never
+ * leaves a shared mapping without its PTE.
+ */
+static int dup_mm_pte(struct mm_struct *mm, addr_t pgn, pte_t pte, addr_t pte_addr, void *priv)
+{
+  struct dup_mm_state *st = priv;
+  addr_t pt_base;
+
+  if (pt_alloc(st->newmm, st->mp, pgn, &pt_base) != 0)
+    return -1;
+
+  if (PAGING_PAGE_SWAPPED(pte)) {
+    if (swap_dup_slot(PAGING_SWPTYP(pte), PAGING_SWP(pte)) != 0)
+      return -1;
+  } else {
+    if (ksm_share(st->newmm, pgn, PAGING_PTE_FPN(pte)) != 0)
+      return -1;
+    SETBIT(pte, PAGING_PTE_COW_MASK);
+  }
+
+  MEMPHY_write64(st->mp, pt_base + PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL) * PAGING64_PTESZ, pte);
+  return 0;
+}
+
+/*
+ * dup_mm_huge - split a huge page before sharing it
+ *
+ * Copy on write works on base pages, so the PMD leaf gives way to a PT
+ * over the same frames, which are then shared one by one.
+ */
+static int dup_mm_huge(struct mm_struct *mm, addr_t pgn, pte_t pmd, addr_t pmd_addr, void *priv)
+{
+  struct dup_mm_state *st = priv;
+  pte_t ptes[PAGING64_HUGE_PGNUM];
+  addr_t fpn = PAGING_PTE_FPN(pmd);
+  addr_t pt_fpn;
+  int i;
+
+  if (MEMPHY_get_zerofp(st->mp, &pt_fpn) != 0)
+    return -1;
+  MEMPHY_set_rmap(st->mp, pt_fpn, mm, MEMPHY_RMAP_PGTBL);
+
+  for (i = 0; i < PAGING64_HUGE_PGNUM; i++) {
+    ptes[i] = 0;
+    pte_fill_fpn(&ptes[i], fpn + i);
+  }
+  MEMPHY_write64_array(st->mp, pt_fpn * PAGING64_PAGESZ, ptes, PAGING64_HUGE_PGNUM);
+
+  pmd = 0;
+  SETBIT(pmd, PAGING_PTE_PRESENT_MASK);
+  SETVAL(pmd, pt_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  MEMPHY_write64(st->mp, pmd_addr, pmd);
+
+  /* Unlike the huge page, its base pages can be evicted */
+  for (i = 0; i < PAGING64_HUGE_PGNUM; i++) {
+    enlist_pgn_node(&mm->fifo_pgn, pgn + i);
+    if (dup_mm_pte(mm, pgn + i, ptes[i], pt_fpn * PAGING64_PAGESZ + i * PAGING64_PTESZ, priv) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * dup_mm - copy an address space for fork
+ * @mm    : address space of the parent
+ * @newmm : address space of the child, fresh from init_mm
+ * @mram  : MEMRAM holding the tables
+ *
+ * No page is copied: every resident page of the parent is shared with the
+ * child, copy on write in both tables, and every swapped page shares its
+ * swap slot. The vm areas, the region table and the FIFO order are copied.
+ * On failure the caller tears newmm down with exit_mm.
+ */
+int dup_mm(struct mm_struct *mm, struct mm_struct *newmm, struct memphy_struct *mram)
+{
+  struct dup_mm_state st = { .newmm = newmm, .mp = mram };
+  const struct pgtbl_walk_ops ops = {
+    .pte_entry = dup_mm_pte,
+    .huge_entry = dup_mm_huge,
+    .priv = &st,
+  };
+  struct vm_area_struct *vma, *newvma, **pvma;
+  struct vm_rg_struct *rg, **prg;
+  struct pgn_t *pg, **ppg;
+  int i;
+
+  /* The vm areas take over the empty one init_mm made */
+  pvma = &newmm->mmap;
+  for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) {
+    if (*pvma == NULL) {
+      *pvma = calloc(1, sizeof(struct vm_area_struct));
+      if (*pvma == NULL)
+        return -1;
+    }
+    newvma = *pvma;
+    while ((rg = newvma->vm_freerg_list) != NULL) {
+      newvma->vm_freerg_list = rg->rg_next;
+      free(rg);
+    }
+
+    newvma->vm_id = vma->vm_id;
+    newvma->vm_start = vma->vm_start;
+    newvma->vm_end = vma->vm_end;
+    newvma->sbrk = vma->sbrk;
+    newvma->vm_mm = newmm;
+
+    prg = &newvma->vm_freerg_list;
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = rg->rg_next) {
+      *prg = init_vm_rg(rg->rg_start, rg->rg_end);
+      prg = &(*prg)->rg_next;
+    }
+    pvma = &newvma->vm_next;
+  }
+
+  memcpy(newmm->symrgtbl, mm->symrgtbl, sizeof(newmm->symrgtbl));
+  for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++)
+    newmm->symrgtbl[i].rg_next = NULL;
+
+  if (pgtbl_walk(mm, mram, 0, (addr_t)-1, &ops) != 0)
+    return -1;
+
+  /* Same victims in the same order, split huge pages included */
+  ppg = &newmm->fifo_pgn;
+  for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next) {
+    *ppg = malloc(sizeof(struct pgn_t));
+    if (*ppg == NULL)
+      return -1;
+    (*ppg)->pgn = pg->pgn;
+    (*ppg)->pg_next = NULL;
+    ppg = &(*ppg)->pg_next;
+  }
+
+  return 0;
+}
+
 // int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 // {
 //   printf("[DEBUG 1] init_mm: START, mm=%p, caller=%p\n", (void*)mm, (void*)caller);
@@ -1237,33 +1758,128 @@ int print_list_pgn(struct pgn_t *ip)
   return 0;
 }
 
+static int print_pgtbl_pte(struct mm_struct *mm, addr_t pgn, pte_t pte, addr_t pte_addr, void *priv)
+{
+  printf("  %08lx: %016lx\n", (unsigned long)pgn, (unsigned long)pte);
+  return 0;
+}
+
+static int print_pgtbl_huge(struct mm_struct *mm, addr_t pgn, pte_t pmd, addr_t pmd_addr, void *priv)
+{
+  printf("  %08lx: %016lx huge\n", (unsigned long)pgn, (unsigned long)pmd);
+  return 0;
+}
+
 int print_pgtbl(struct pcb_t *caller, addr_t start, addr_t end)
 {
   struct krnl_t *krnl = caller->krnl;
-  addr_t pgd, p4d, pud, pmd, pt;
+  const struct pgtbl_walk_ops ops = {
+    .pte_entry = print_pgtbl_pte,
+    .huge_entry = print_pgtbl_huge,
+  };
+  static const char *const names[] = { "PDG", "P4g", "PUD", "PMD" };
+  addr_t base = (addr_t)krnl->mm->pgd;
+  pte_t entry;
+  int lv;
+
+  // Walk and read each level above the PT, folded ones are not printed
+  printf("print_pgtbl: ");
+  for (lv = 0; lv < PAGING64_PT_LEVEL; lv++) {
+    addr_t idx = PAGING64_ADDR_IDX(start, lv);
+
+    entry = get_64bit_entry(base + idx * PAGING64_PTESZ, krnl->mram);
+    printf(" %s=%lx%lx", names[lv == 0 ? 0 : 3 - (PAGING64_PMD_LEVEL - lv)],
+           (unsigned long)idx, (unsigned long)entry);
+    if (!PAGING_PAGE_PRESENT(entry) || PAGING_PAGE_HUGE(entry))
+      break;
+    base = PAGING_PTE_FPN(entry) * PAGING64_PAGESZ;
+  }
+  printf("\n");
+
+  /* Then every mapped page of the range, empty tables are skipped */
+  if (end > start)
+    pgtbl_walk(krnl->mm, krnl->mram, PAGING64_PGN(start), PAGING64_PGN(end - 1) + 1, &ops);
+
+  return 0;
+}
+
+/*
+ * Frames of an address space, collected for print_mm_frames
+ */
+struct mm_frames {
+  addr_t *fpn;
+  int nr;
+  int max;
+};
 
-  get_pd_from_address(start, &pgd, &p4d, &pud, &pmd, &pt);
+static int mm_frames_add(struct mm_frames *fr, addr_t fpn)
+{
+  addr_t *grown;
+
+  if (fr->nr == fr->max) {
+    grown = realloc(fr->fpn, (fr->max ? 2 * fr->max : 64) * sizeof(addr_t));
+    if (grown == NULL)
+      return -1;
+    fr->fpn = grown;
+    fr->max = fr->max ? 2 * fr->max : 64;
+  }
+  fr->fpn[fr->nr++] = fpn;
+  return 0;
+}
 
-  // Walk and read each level
-  addr_t pgd_entry = get_32bit_entry((addr_t)krnl->mm->pgd + pgd * 4, krnl->mram);
-  addr_t p4d_entry = get_32bit_entry(((pgd_entry & 0x1FFF) * PAGING64_PAGESZ) + p4d * 4, krnl->mram);
-  addr_t pud_entry = get_32bit_entry(((p4d_entry & 0x1FFF) * PAGING64_PAGESZ) + pud * 4, krnl->mram);
-  addr_t pmd_entry = get_32bit_entry(((pud_entry & 0x1FFF) * PAGING64_PAGESZ) + pmd * 4, krnl->mram);
+static int mm_frames_pte(struct mm_struct *mm, addr_t pgn, pte_t pte, addr_t pte_addr, void *priv)
+{
+  /* A swapped page has no frame in MEMRAM */
+  if (PAGING_PAGE_SWAPPED(pte))
+    return 0;
+  return mm_frames_add(priv, PAGING_PTE_FPN(pte));
+}
 
-  printf("print_pgtbl:  PDG=%lx%x P4g=%lx%x PUD=%lx%x PMD=%lx%x\n",
-         pgd, (unsigned int)pgd_entry, p4d, (unsigned int)p4d_entry,
-         pud, (unsigned int)pud_entry, pmd, (unsigned int)pmd_entry);
+static int mm_frames_huge(struct mm_struct *mm, addr_t pgn, pte_t pmd, addr_t pmd_addr, void *priv)
+{
+  addr_t pgit;
 
+  for (pgit = 0; pgit < PAGING64_HUGE_PGNUM; pgit++)
+    if (mm_frames_add(priv, PAGING_PTE_FPN(pmd) + pgit) != 0)
+      return -1;
   return 0;
 }
 
-addr_t get_32bit_entry(addr_t base_address, struct memphy_struct* mp){
-  addr_t entry = 0;
-  for(int i = 0; i < 4; i++){
-    BYTE byte_val;
-    if((MEMPHY_read(mp, base_address + i, &byte_val)) != 0) return -1;
-    entry |= ((addr_t)byte_val) << (i*8);
-  }
+static int mm_frames_table(struct mm_struct *mm, addr_t fpn, int level, void *priv)
+{
+  return mm_frames_add(priv, fpn);
+}
+
+/*
+ * print_mm_frames - print the non-zero frames of the caller, mmvm_lock held
+ * @caller : process
+ *
+ * The frames are found from its page table, so the cost follows what the
+ * process maps rather than the MEMRAM size. Shared frames are printed by
+ * the process their rmap names, as with a whole device dump.
+ */
+int print_mm_frames(struct pcb_t *caller)
+{
+  struct krnl_t *krnl = caller->krnl;
+  struct mm_frames fr = { NULL, 0, 0 };
+  struct pgtbl_walk_ops ops = {
+    .pte_entry = mm_frames_pte,
+    .huge_entry = mm_frames_huge,
+    .table_exit = mm_frames_table,
+    .priv = &fr,
+  };
+  int ret = -1;
+
+  if (pgtbl_walk(krnl->mm, krnl->mram, 0, (addr_t)-1, &ops) == 0)
+    ret = MEMPHY_dump_frames(krnl->mram, fr.fpn, fr.nr, krnl->mm->pid, stdout);
+
+  free(fr.fpn);
+  return ret;
+}
+
+pte_t get_64bit_entry(addr_t base_address, struct memphy_struct* mp){
+  uint64_t entry;
+  if (MEMPHY_read64(mp, base_address, &entry) != 0) return 0;
   return entry;
 }
 // addr_t get_32bit_entry(addr_t base_address, struct memphy_struct* mp){
@@ -1286,79 +1902,52 @@ addr_t get_32bit_entry(addr_t base_address, struct memphy_struct* mp){
 // }
 
 int translate_address(struct mm_struct* mm, struct memphy_struct* mp, addr_t vaddr, addr_t* paddr){
-  addr_t pgd, p4d, pud, pmd, pt;
-  get_pd_from_address(vaddr, &pgd, &p4d, &pud, &pmd, &pt);
-
-  // Level 1: PGD
-  addr_t pgd_base = (addr_t)mm->pgd;
-  addr_t pgd_entry = get_32bit_entry(pgd_base + pgd * 4, mp);
-  if(!(pgd_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-
-  addr_t p4d_base = (pgd_entry & 0x1FFF) * PAGING64_PAGESZ;  // Convert FPN to address
-
-  // Level 2: P4D
-  addr_t p4d_entry = get_32bit_entry(p4d_base + p4d * 4, mp);
-  if(!(p4d_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-
-  addr_t pud_base = (p4d_entry & 0x1FFF) * PAGING64_PAGESZ;  // Convert FPN to address
-
-  // Level 3: PUD
-  addr_t pud_entry = get_32bit_entry(pud_base + pud * 4, mp);
-  if(!(pud_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-
-  addr_t pmd_base = (pud_entry & 0x1FFF) * PAGING64_PAGESZ;  // Convert FPN to address
-
-  // Level 4: PMD
-  addr_t pmd_entry = get_32bit_entry(pmd_base + pmd * 4, mp);
-  if(!(pmd_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-
-  addr_t pt_base = (pmd_entry & 0x1FFF) * PAGING64_PAGESZ;  // Convert FPN to address
+  addr_t pte_addr;
+  pte_t pte;
+  int ret;
 
-  // Level 5: PT (final page table)
-  addr_t pt_entry = get_32bit_entry(pt_base + pt * 4, mp);
-  if(!(pt_entry & PAGING_PTE_PRESENT_MASK)) return -1;
+  ret = get_pte_address(mm, mp, PAGING64_PGN(vaddr), &pte_addr);
+  if (ret < 0) return -1;
 
-  addr_t fpn = pt_entry & 0x1FFF;  // Extract FPN (bits 0-12)
-  addr_t page_base = fpn * PAGING64_PAGESZ;  // Convert to physical address
+  pte = get_64bit_entry(pte_addr, mp);
+  if (!PAGING_PAGE_PRESENT(pte)) return -1;
 
-  // Add offset
-  addr_t offset = vaddr & 0xFFF;
-  *paddr = page_base + offset;
+  // Huge page: the PMD leaf maps a run of PAGING64_HUGE_PGNUM frames
+  if (ret == 1) {
+    *paddr = PAGING_PTE_FPN(pte) * PAGING64_PAGESZ + (vaddr & (PAGING64_HUGESZ - 1));
+    return 0;
+  }
 
+  *paddr = PAGING_PTE_FPN(pte) * PAGING64_PAGESZ + PAGING64_OFFST(vaddr);
   return 0;
 }
 
 int get_pte_address(struct mm_struct* mm, struct memphy_struct* mp, addr_t pgn, addr_t* pte_addr){
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
+  addr_t pmd_addr, pt_base;
+  pte_t pmd_entry;
 
-  // Level 1: PGD
-  addr_t pgd_base = (addr_t)mm->pgd;
-  addr_t pgd_entry = get_32bit_entry(pgd_base + pgd_idx * 4, mp);
-  if (!(pgd_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-  
-  addr_t p4d_base = (pgd_entry & 0x1FFF) * PAGING64_PAGESZ;
+  // Nearby pages share the upper levels, skip straight to the PT
+  if (pwc_lookup(mm, pgn, &pt_base) == 0) {
+    *pte_addr = pt_base + PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL) * PAGING64_PTESZ;
+    return 0;
+  }
 
-  // Level 2: P4D
-  addr_t p4d_entry = get_32bit_entry(p4d_base + p4d_idx * 4, mp);
-  if (!(p4d_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-  
-  addr_t pud_base = (p4d_entry & 0x1FFF) * PAGING64_PAGESZ;
+  if (pgtbl_entry_addr(mm, mp, pgn, PAGING64_PMD_LEVEL, 0, &pmd_addr) != 0) return -1;
 
-  // Level 3: PUD
-  addr_t pud_entry = get_32bit_entry(pud_base + pud_idx * 4, mp);
-  if (!(pud_entry & PAGING_PTE_PRESENT_MASK)) return -1;
-  
-  addr_t pmd_base = (pud_entry & 0x1FFF) * PAGING64_PAGESZ;
+  pmd_entry = get_64bit_entry(pmd_addr, mp);
+  if (!PAGING_PAGE_PRESENT(pmd_entry)) return -1;
 
-  // Level 4: PMD
-  addr_t pmd_entry = get_32bit_entry(pmd_base + pmd_idx * 4, mp);
-  if (!(pmd_entry & PAGING_PTE_PRESENT_MASK)) return -1;
+  // A huge page ends the walk at the PMD, hand back the leaf entry
+  if (PAGING_PAGE_HUGE(pmd_entry)) {
+    *pte_addr = pmd_addr;
+    return 1;
+  }
   
-  addr_t pt_base = (pmd_entry & 0x1FFF) * PAGING64_PAGESZ;
+  pt_base = PAGING_PTE_FPN(pmd_entry) * PAGING64_PAGESZ;
+  pwc_insert(mm, pgn, pt_base);
 
-  // Level 5: PT - Return the ADDRESS of the PTE (not the content!)
-  *pte_addr = pt_base + pt_idx * 4;
+  // Last level: PT - Return the ADDRESS of the PTE (not the content!)
+  *pte_addr = pt_base + PAGING64_PGN_IDX(pgn, PAGING64_PT_LEVEL) * PAGING64_PTESZ;
   
   return 0;
 }
@@ -3,6 +3,7 @@
 #include "timer.h"
 #include "sched.h"
 #include "loader.h"
+#include "libmem.h"
 
 #include "mm.h"
 
@@ -17,8 +18,8 @@ static int done = 0;
 static struct krnl_t os;
 
 #ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
+static unsigned long memramsz;
+static unsigned long memswpsz[PAGING_MAX_MMSWP];
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -52,6 +53,13 @@ static void * cpu_routine(void * args) {
 	/* Check for new process in ready queue */
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
+#ifdef MM_PAGING
+	/* Frame allocations of this thread go through CPU id's magazine,
+	 * translations through its TLB
+	 */
+	MEMPHY_set_cpu(id);
+	tlb_set_cpu(id);
+#endif
 	while (1) {
 		/* Check the status of current process */
 		if (proc == NULL) {
@@ -66,6 +74,15 @@ static void * cpu_routine(void * args) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
+			finish_proc(proc);
+#ifdef MM_PAGING
+			kswapd_unregister(proc);
+			free_pcb_memph(proc);
+#endif
+			free(proc->krnl);
+			free(proc->code->text);
+			free(proc->code);
+			free(proc->page_table);
 			free(proc);
 			proc = get_proc();
 			time_left = 0;
@@ -107,6 +124,7 @@ static void * ld_routine(void * args) {
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
+	int active_mswp_id = ((struct mmpaging_ld_args *)args)->active_mswp_id;
 	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
@@ -129,7 +147,9 @@ static void * ld_routine(void * args) {
 		krnl->mram = mram;
 		krnl->mswp = mswp;
 		krnl->active_mswp = active_mswp;
+		krnl->active_mswp_id = active_mswp_id;
 		init_mm(krnl->mm, proc);
+		kswapd_register(proc);
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
 			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
@@ -172,9 +192,9 @@ static void read_config(const char * path) {
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
 	*/
-	fscanf(file, "%d\n", &memramsz);
+	fscanf(file, "%lu\n", &memramsz);
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
+		fscanf(file, "%lu", &(memswpsz[sit])); 
 
        fscanf(file, "\n"); /* Final character */
 #endif
@@ -228,24 +248,58 @@ int main(int argc, char * argv[]) {
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
 	int rdmflag = 1; /* By default memphy is RANDOM ACCESS MEMORY */
+#ifdef MEMSWP_SEQ
+	int swprdmflag = 0;
+#else
+	int swprdmflag = rdmflag;
+#endif
 
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+	struct memphy_struct *mswp_list[PAGING_MAX_MMSWP];
 
 	/* Create MEM RAM */
 	init_memphy(&mram, memramsz, rdmflag);
+#ifdef MM_ZSWAP
+	zswap_init(&mram, ZSWAP_POOL_PERCENT);
+#endif
+#ifdef MM_KSWAPD
+	kswapd_init(&mram, KSWAPD_WMARK_LOW, KSWAPD_WMARK_HIGH);
+#endif
+	/* Shared frames of fork and of same page merging */
+	ksm_init(&mram);
+#ifdef MM_KSM
+	ksmd_init(&mram, KSM_SCAN_INTERVAL);
+#endif
 
         /* Create all MEM SWAP */ 
 	int sit;
+#ifdef MEMSWP_FILE
+	char swpfile[100];
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		snprintf(swpfile, sizeof(swpfile), MEMSWP_FILE, sit);
+		init_memphy_file(&mswp[sit], memswpsz[sit], swprdmflag, swpfile);
+	}
+#else
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	       init_memphy(&mswp[sit], memswpsz[sit], swprdmflag);
+#endif
+	/* Switch on every configured MEMSWP, striped unless ordered by index */
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		mswp_list[sit] = &mswp[sit];
+#ifdef MEMSWP_PRIO_ORDER
+		swap_on(&mswp[sit], sit, PAGING_MAX_MMSWP - sit);
+#else
+		swap_on(&mswp[sit], sit, 0);
+#endif
+	}
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
 	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
+	mm_ld_args->mswp = mswp_list;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
 #endif
@@ -273,6 +327,31 @@ int main(int argc, char * argv[]) {
 	/* Stop timer */
 	stop_timer();
 
+#ifdef MM_PAGING
+	kswapd_stop();
+#ifdef MM_KSM
+	ksmd_stop();
+	ksm_report();
+#endif
+	ksm_exit();
+
+#ifdef MM_TLB
+	tlb_report();
+#endif
+
+	/* Drain the swap queues and report swap usage and seek cost */
+	swap_report();
+#ifdef MM_ZSWAP
+	zswap_report();
+	zswap_exit();
+#endif
+
+	/* Release MEMPHY, file backed swap is written back to its file */
+	free_memphy(&mram);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		free_memphy(&mswp[sit]);
+#endif
+
 	return 0;
 	
 }
@@ -249,4 +249,12 @@ void add_proc(struct pcb_t * proc) {
 }
 #endif
 
+/* Remove a finished process from the running list */
+void finish_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+
 
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "syscall.h"
+#include "libmem.h"
+#include "loader.h"
+#include "queue.h"
+#include "sched.h"
+#include "mm.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void free_forked_pcb(struct pcb_t *child)
+{
+    if (child->code != NULL)
+        free(child->code->text);
+    free(child->code);
+    free(child->page_table);
+    free(child->krnl);
+    free(child);
+}
+
+/*
+ * fork - duplicate the calling process
+ *
+ * syscall 2 [reg]: the child runs the same code from the instruction
+ * after the syscall, with its own PID and a copy on write copy of the
+ * memory of its parent. It is scheduled through add_proc like a loaded
+ * process. The parent finds the PID of the child in register reg, 0 when
+ * left out, and the child finds 0 there.
+ */
+int __sys_fork(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+    struct pcb_t *caller = NULL, *child;
+    struct queue_t *rq = krnl->running_list;
+    int i;
+
+    /* Only a running process can call */
+    for (i = 0; rq != NULL && i < rq->size; i++) {
+        if (rq->proc[i] && rq->proc[i]->pid == pid) {
+            caller = rq->proc[i];
+            break;
+        }
+    }
+    if (caller == NULL)
+        return -1;
+
+    child = malloc(sizeof(struct pcb_t));
+    if (child == NULL)
+        return -1;
+    *child = *caller;
+    child->krnl = malloc(sizeof(struct krnl_t));
+    child->code = malloc(sizeof(struct code_seg_t));
+    child->page_table = malloc(sizeof(struct page_table_t));
+    if (child->code != NULL)
+        child->code->text = malloc(sizeof(struct inst_t) * caller->code->size);
+    if (child->krnl == NULL || child->code == NULL || child->code->text == NULL ||
+        child->page_table == NULL) {
+        free_forked_pcb(child);
+        return -1;
+    }
+
+    /* Every process frees its own code and kernel view when it ends */
+    *child->krnl = *krnl;
+    child->code->size = caller->code->size;
+    memcpy(child->code->text, caller->code->text, sizeof(struct inst_t) * caller->code->size);
+    memcpy(child->page_table, caller->page_table, sizeof(struct page_table_t));
+    child->pid = get_pid();
+
+#ifdef MM_PAGING
+    if (dup_pcb_memph(caller, child) != 0) {
+        free_forked_pcb(child);
+        return -1;
+    }
+    kswapd_register(child);
+#endif
+
+    if (regs->a1 < sizeof(caller->regs) / sizeof(caller->regs[0])) {
+        caller->regs[regs->a1] = child->pid;
+        child->regs[regs->a1] = 0;
+    }
+
+    printf("\tForked process %d from %d\n", child->pid, caller->pid);
+    add_proc(child);
+
+    return 0;
+}
@@ -50,6 +50,7 @@ static struct pcb_t *find_pcb_by_pid(struct krnl_t *krnl, uint32_t pid)
 int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
 {
     int memop = regs->a1;
+    int ret = 0;
     BYTE value;
     struct pcb_t *caller = find_pcb_by_pid(krnl, pid);
     if (caller == NULL) {
@@ -64,11 +65,11 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
         break;
 
     case SYSMEM_INC_OP:
-        inc_vma_limit(caller, regs->a2, regs->a3);
+        ret = inc_vma_limit(caller, regs->a2, regs->a3);
         break;
 
     case SYSMEM_SWP_OP:
-        __mm_swap_page(caller, regs->a2, regs->a3);
+        ret = __mm_swap_page(caller, regs->a2, regs->a3);
         break;
 
     case SYSMEM_IO_READ:
@@ -85,5 +86,5 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
         break;
     }
 
-    return 0;
+    return ret;
 }